@@ -100,7 +100,9 @@ const char *fatGetDefaultDrive(void);
 /// @param fd
 ///     The file descriptor to initialize. Use fileno(file) for FILE * inputs.
 /// @param max_buffer_size
-///     The maximum buffer size, in bytes.
+///     The maximum buffer size, in bytes. If it is 0, the buffer is sized to
+///     fit the whole file, and it is placed in the unused DLDI driver space if
+///     it fits there.
 ///
 /// @return
 ///     0 if the initialization was successful, a non-zero value on error.
@@ -40,6 +40,84 @@ bool nitroFSInit(const char *basepath);
 ///     initialized before, it will also return true.
 bool nitroFSExit(void);
 
+/// Mounts a NitroFS image stored in a .nds file as a new drive.
+///
+/// This can be used to access the files of additional .nds files (like patches
+/// or downloadable content) without copying them to the SD card. The FNT and
+/// FAT of the image are loaded to RAM if possible, so that opening files
+/// doesn't need to access the SD card. A hash table of all the paths of the
+/// image is built as well, so that each component of a path is found without
+/// scanning the directory that contains it.
+///
+/// FAT must have been initialized before calling this function.
+///
+/// Example:
+///
+/// ```
+/// nitroFSMount("fat:/game/dlc1.nds", "dlc:/");
+/// FILE *f = fopen("dlc:/levels/level1.bin", "rb");
+/// ```
+///
+/// @param path
+///     The .nds file path.
+/// @param mountpoint
+///     The name of the new drive, like "dlc:/". It can't be longer than 8
+///     characters, including the colon.
+///
+/// @return
+///     It returns true on success, false on error.
+WARN_UNUSED_RESULT
+bool nitroFSMount(const char *path, const char *mountpoint);
+
+/// Mounts a drive that combines several NitroFS drives.
+///
+/// Every path used in the new drive is looked up in each one of the drives
+/// passed to this function, in order, and the first drive that contains it is
+/// used. This allows a patch to replace some files of the original game, while
+/// the rest of the files are still read from the original game.
+///
+/// Directory listings only show the contents of the first drive that contains
+/// the directory.
+///
+/// The tables of all the drives of the overlay are loaded to RAM and indexed
+/// like in nitroFSMount(), including "nitro:/". Paths are looked up in each
+/// drive with the index, so the cost of a lookup depends on the number of
+/// drives and path components, not on the size of the directories. If there
+/// isn't enough RAM for the tables of a drive, its directories are scanned.
+///
+/// Example:
+///
+/// ```
+/// const char *images[] = { "dlc:/", "nitro:/" };
+/// nitroFSMountOverlay("game:/", images, 2);
+/// ```
+///
+/// @param mountpoint
+///     The name of the new drive, like "game:/".
+/// @param images
+///     List of drives mounted with nitroFSInit() or nitroFSMount(), with the
+///     highest priority first.
+/// @param count
+///     Number of drives in the list.
+///
+/// @return
+///     It returns true on success, false on error.
+WARN_UNUSED_RESULT
+bool nitroFSMountOverlay(const char *mountpoint, const char *const *images,
+                         size_t count);
+
+/// Unmounts a drive mounted with nitroFSMount() or nitroFSMountOverlay().
+///
+/// Drives that are part of an overlay can't be unmounted before the overlay.
+/// Using it with "nitro:/" is the same as calling nitroFSExit().
+///
+/// @param mountpoint
+///     The name of the drive, like "dlc:/".
+///
+/// @return
+///     It returns true on success, false on error.
+bool nitroFSUnmount(const char *mountpoint);
+
 /// This function initializes a NitroFS lookup cache.
 ///
 /// This lookup cache allows avoiding expensive SD card lookups for large
@@ -48,8 +126,12 @@ bool nitroFSExit(void);
 /// This function will return 0 on non-DLDI/SD NitroFS accesses, as lookup
 /// caches are unnecessary in these situations.
 ///
+/// nitroFSInit() already initializes a lookup cache that fits the whole file,
+/// so it isn't normally needed to call this function.
+///
 /// @param max_buffer_size
-///     The maximum buffer size, in bytes.
+///     The maximum buffer size, in bytes. If it is 0, the buffer is sized to
+///     fit the whole file.
 ///
 /// @return
 ///     0 if the initialization was successful, a non-zero value on error.
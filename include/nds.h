@@ -47,6 +47,7 @@
 /// - @ref fat.h "Simple replacement of libfat"
 /// - @ref filesystem.h "NitroFS, filesystem embedded in a NDS ROM"
 /// - @ref nds/arm9/sdmmc.h "ARM9 SDMMC Module"
+/// - @ref nds/arm9/storage_trace.h "Tracing of storage device accesses"
 ///
 /// @section system_api System
 /// - @ref nds/ndstypes.h "Custom DS types"
@@ -142,6 +143,8 @@ extern "C" {
 #include <nds/dma.h>
 #include <nds/exceptions.h>
 #include <nds/fifocommon.h>
+#include <nds/fiforing.h>
+#include <nds/fiforpc.h>
 #include <nds/input.h>
 #include <nds/interrupts.h>
 #include <nds/ipc.h>
@@ -180,6 +183,7 @@ extern "C" {
 #    include <nds/arm9/sdmmc.h>
 #    include <nds/arm9/sound.h>
 #    include <nds/arm9/sprite.h>
+#    include <nds/arm9/storage_trace.h>
 #    include <nds/arm9/trig_lut.h>
 #    include <nds/arm9/video.h>
 #    include <nds/arm9/videoGL.h>
@@ -28,6 +28,9 @@ void inputSetLidSleepDuration(u16 frames);
 
 /// Send ARM7-side input information (X, Y, touch, lid) to ARM9 via FIFO.
 ///
+/// If the ARM9 has called keysEnableSharedInput(), the information is written
+/// to shared memory instead.
+///
 /// This should ideally be called once per frame on the ARM7 CPU.
 void inputGetAndSend(void);
 
@@ -78,6 +78,7 @@ typedef struct
     u32 cid[4];  // Raw CID without the CRC.
     u16 ccc;     // (e)MMC/SD command class support from CSD. One per bit starting at 0.
     u8 busWidth; // The current bus width used to talk to the card.
+    u8 highSpeed; // 1 if the card supports High Speed mode, 0 if not. It isn't used.
 } SdmmcInfo;
 
 typedef struct
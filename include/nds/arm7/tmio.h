@@ -304,6 +304,7 @@ static inline u32 TMIO_CLK2DIV(u32 clk)
 typedef struct
 {
     u8 portNum;
+    u8 noAutoStop;   // 1 = Don't send STOP_TRANSMISSION after multi-block transfers.
     u16 sd_clk_ctrl;
     u16 sd_blocklen; // Also sd_blocklen32.
     u16 sd_option;
@@ -410,6 +411,21 @@ static inline void TMIO_setBuffer(TmioPort *const port, void *buf, const u16 blo
     port->blocks = blocks;
 }
 
+/// Enables or disables the automatic STOP_TRANSMISSION after multi-block
+/// transfers of a tmio port.
+///
+/// It must be disabled for transfers with a predefined number of blocks
+/// (SET_BLOCK_COUNT).
+///
+/// @param port
+///     A pointer to the port struct.
+/// @param[in] enable
+///     True to send STOP_TRANSMISSION automatically (default).
+static inline void TMIO_setAutoStop(TmioPort *const port, const bool enable)
+{
+    port->noAutoStop = enable ? 0 : 1;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -10,6 +10,8 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 #include <nds/arm9/dldi_asm.h>
 #include <nds/disc_io.h>
 
@@ -106,6 +108,39 @@ static inline void dldiFixDriverAddresses(DLDI_INTERFACE *io)
     dldiRelocate(io, io);
 }
 
+/// Maximum number of extents sent to the ARM7 in one message by
+/// dldiReadSectorsList() and dldiWriteSectorsList().
+#define DLDI_LIST_MAX_EXTENTS   32
+
+/// Read a list of runs of sectors with the internal DLDI driver.
+///
+/// In DLDI_MODE_ARM7 all the extents are sent to the ARM7 in one message (up
+/// to DLDI_LIST_MAX_EXTENTS at a time), and the ARM7 reads them one after the
+/// other. This is faster than calling readSectors() for each extent. In
+/// DLDI_MODE_ARM9 the driver is called once for each extent.
+///
+/// @param extents
+///     List of extents. The buffers must be in main RAM.
+/// @param count
+///     Number of extents.
+///
+/// @return
+///     True on success. On error, some extents may have been read.
+bool dldiReadSectorsList(const DISC_EXTENT *extents, size_t count);
+
+/// Write a list of runs of sectors with the internal DLDI driver.
+///
+/// @see dldiReadSectorsList()
+///
+/// @param extents
+///     List of extents. The buffers must be in main RAM.
+/// @param count
+///     Number of extents.
+///
+/// @return
+///     True on success. On error, some extents may have been written.
+bool dldiWriteSectorsList(const DISC_EXTENT *extents, size_t count);
+
 /// Load a DLDI driver from a file and set up the bus permissions.
 ///
 /// This is not directly usable as a filesystem driver.
@@ -21,7 +21,8 @@ extern "C" {
 /// file. Compressed blobs may use different compression algorithms. Check the
 /// documentation of decompress() for more information about the supported
 /// formats. Note that all compression formats supported by grit are also
-/// supported by decompress().
+/// supported by decompress(). Chunks compressed with LZ4 (type 0x40) are also
+/// supported.
 ///
 /// Check https://www.coranac.com/man/grit/html/grit.htm for more information.
 
@@ -216,6 +217,13 @@ GRFError grfLoadFile(FILE *file, GRFHeader *header,
 
 /// From a FILE* to a GRF file, extract all data and allocate memory for it.
 ///
+/// Compressed chunks are decompressed while they are read from the file, so
+/// they don't need to be loaded to RAM first. Only a small buffer is used to
+/// read them, and the data is written straight to the destination buffers,
+/// which can be in VRAM. Chunks that use LZ77 type 0x11 or LZ4, and Huffman
+/// chunks when the software decompression backend is selected, are loaded to
+/// RAM before decompressing them.
+///
 /// @note
 ///     Check grfLoadMemEx() for details about how to use this function.
 ///
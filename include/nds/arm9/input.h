@@ -95,6 +95,81 @@ static inline __attribute__((deprecated)) touchPosition touchReadXY(void)
     return touchPos;
 }
 
+/// Number of samples kept in the input history in shared memory mode.
+#define KEYS_SHARED_HISTORY_SIZE 8
+
+/// Makes the ARM7 share the input state through main RAM.
+///
+/// By default, the ARM7 sends the state of the keys and the touch screen to the
+/// ARM9 with a FIFO message every time it reads them. In shared memory mode the
+/// ARM7 writes it to a block of main RAM instead, and scanKeys() reads the
+/// latest state from it directly. This saves one FIFO message and interrupt
+/// for each update, and scanKeys() always gets the latest state.
+///
+/// The block also contains the last KEYS_SHARED_HISTORY_SIZE samples, which
+/// can be read with keysGetHistory().
+///
+/// @return
+///     Returns true on success, false if there isn't enough memory.
+bool keysEnableSharedInput(void);
+
+/// Makes the ARM7 send the input state with FIFO messages again.
+void keysDisableSharedInput(void);
+
+/// Gets the latest input samples taken by the ARM7 in shared memory mode.
+///
+/// @param samples
+///     Array to store the samples, starting from the latest one.
+/// @param max_samples
+///     Size of the array.
+///
+/// @return
+///     Number of samples stored in the array. It is 0 if the shared memory mode
+///     isn't enabled.
+int keysGetHistory(InputSample *samples, int max_samples);
+
+/// Minimum rate of the high-rate touch sampling mode in Hz.
+#define TOUCH_SAMPLING_MIN_RATE 60
+
+/// Maximum rate of the high-rate touch sampling mode in Hz.
+#define TOUCH_SAMPLING_MAX_RATE 1000
+
+/// Starts sampling the touch screen at a high rate.
+///
+/// Normally, the ARM7 reads the touch screen once per frame. In this mode the
+/// ARM7 also reads it from a timer interrupt and sends all the samples to the
+/// ARM9 through a ring buffer in main RAM. This is useful for handwriting or
+/// gesture recognition. Read the samples with touchSamplingRead() every frame.
+///
+/// The ARM7 uses timer 2 for this. Each interrupt reads the touch screen at
+/// most once, and it only checks if the pen is down while it isn't touching the
+/// screen. When the pen is lifted, one sample with TOUCH_SAMPLE_PEN_UP is sent.
+/// If the ring buffer is full, new samples are dropped.
+///
+/// @param rate_hz
+///     Samples per second (TOUCH_SAMPLING_MIN_RATE to TOUCH_SAMPLING_MAX_RATE).
+/// @param max_samples
+///     Number of samples that the ring buffer can hold. It is rounded up to a
+///     power of two.
+///
+/// @return
+///     Returns true on success, false on error.
+bool touchSamplingStart(u32 rate_hz, u32 max_samples);
+
+/// Stops the high-rate touch sampling mode and frees the ring buffer.
+void touchSamplingStop(void);
+
+/// Reads samples taken by the high-rate touch sampling mode.
+///
+/// @param samples
+///     Array to store the samples, starting from the oldest one.
+/// @param max_samples
+///     Size of the array.
+///
+/// @return
+///     Number of samples stored in the array.
+int touchSamplingRead(TouchSample *samples, int max_samples);
+
 #ifdef __cplusplus
 }
 #endif
@@ -81,6 +81,83 @@ bool nand_ReadSectors(sec_t sector, sec_t numSectors, void *buffer);
 ///     Returns true on success or false on failure.
 bool nand_WriteSectors(sec_t sector, sec_t numSectors, const void *buffer);
 
+/// Maximum number of queued requests that can be pending at the same time.
+#define SDMMC_QUEUE_MAX_REQUESTS    16
+
+/// Adds a read request to the queue of the ARM7 and returns without waiting.
+///
+/// Queued requests are only supported in DSi mode. sdmmc_QueueWait() must be
+/// called for all requests to release them.
+///
+/// The ARM7 handles queued requests one after the other without waiting for
+/// the ARM9, and it merges requests of consecutive sectors that use consecutive
+/// buffers into a single multi-block command. This is useful to keep the bus
+/// busy while streaming data.
+///
+/// The buffer must not be accessed until the request is finished. It should
+/// be aligned to 32 bytes so that the cache can be managed safely.
+///
+/// @param[in] device
+///     SDMMC_DEVICE_SD or SDMMC_DEVICE_NAND.
+/// @param[in] sector
+///     The start sector.
+/// @param[in] numSectors
+///     The number of sectors to read (up to 65535).
+/// @param buffer
+///     The output buffer pointer.
+///
+/// @return
+///     Returns the ID of the request, or -1 on error, if there are already
+///     SDMMC_QUEUE_MAX_REQUESTS pending requests or if it isn't running in DSi
+///     mode.
+int sdmmc_QueueReadSectors(int device, sec_t sector, sec_t numSectors,
+                           void *buffer);
+
+/// Adds a write request to the queue of the ARM7 and returns without waiting.
+///
+/// @param[in] device
+///     SDMMC_DEVICE_SD or SDMMC_DEVICE_NAND.
+/// @param[in] sector
+///     The start sector.
+/// @param[in] numSectors
+///     The number of sectors to write (up to 65535).
+/// @param[in] buffer
+///     The input buffer pointer.
+///
+/// @return
+///     Returns the ID of the request, or -1 on error, if there are already
+///     SDMMC_QUEUE_MAX_REQUESTS pending requests or if it isn't running in DSi
+///     mode.
+int sdmmc_QueueWriteSectors(int device, sec_t sector, sec_t numSectors,
+                            const void *buffer);
+
+/// Checks if a queued request has been handled by the ARM7.
+///
+/// This function doesn't release the request. sdmmc_QueueWait() must be called
+/// for every request, even after this function has returned true. That call
+/// doesn't wait, but it invalidates the buffer of read requests from the data
+/// cache, gets the result and releases the slot of the request.
+///
+/// @param[in] id
+///     ID returned by sdmmc_QueueReadSectors() or sdmmc_QueueWriteSectors().
+///
+/// @return
+///     Returns true if the request has finished or if the ID isn't valid.
+bool sdmmc_QueueIsDone(int id);
+
+/// Waits until a queued request has been handled by the ARM7.
+///
+/// The thread sleeps until the ARM7 reports that it has finished a batch of
+/// requests, so other cothreads can run while it waits, even if they have
+/// lower priority. The ID can't be used after calling this function.
+///
+/// @param[in] id
+///     ID returned by sdmmc_QueueReadSectors() or sdmmc_QueueWriteSectors().
+///
+/// @return
+///     Returns true on success or false on failure.
+bool sdmmc_QueueWait(int id);
+
 // Compatibility macros.
 #define nand_GetSize nand_GetSectors
 
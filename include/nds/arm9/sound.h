@@ -359,6 +359,167 @@ void soundMicPowerOn(void);
 /// Powers off the microphone after powering it on with soundMicPowerOn().
 void soundMicPowerOff(void);
 
+/// Batch of sound commands.
+///
+/// Every function like soundPlaySampleChannel() sends a message to the ARM7
+/// and waits for its answer. Batches let you record many commands and send
+/// all of them to the ARM7 in a single message without waiting for the answer.
+/// The ARM7 applies all the commands of a batch at the same time, with
+/// interrupts disabled.
+///
+/// Example:
+///
+/// ```
+/// SoundBatch *batch = soundBatchCreate(16);
+///
+/// int shot = soundBatchPlaySample(batch, -1, shot_data, SoundFormat_8Bit,
+///                                 shot_size, 11025, 127, 64, false, 0);
+/// soundBatchKill(batch, music_channel);
+/// soundBatchSubmit(batch);
+///
+/// // ...
+///
+/// if (soundBatchIsDone(batch))
+/// {
+///     int shot_channel = soundBatchGetResult(batch, shot);
+///     soundBatchReset(batch);
+/// }
+/// ```
+typedef struct SoundBatch SoundBatch;
+
+/// Creates a batch of sound commands.
+///
+/// @param max_commands
+///     Maximum number of commands that can be stored in the batch.
+///
+/// @return
+///     A pointer to the batch, or NULL on error.
+SoundBatch *soundBatchCreate(unsigned int max_commands);
+
+/// Frees a batch of sound commands.
+///
+/// The batch must not be waiting to be applied by the ARM7.
+///
+/// @param batch
+///     Batch to be freed.
+void soundBatchFree(SoundBatch *batch);
+
+/// Removes all commands from a batch so that it can be reused.
+///
+/// The batch must not be waiting to be applied by the ARM7.
+///
+/// @param batch
+///     Batch to be reset.
+void soundBatchReset(SoundBatch *batch);
+
+/// Adds a command to play a sample to a batch.
+///
+/// The arguments are the same as in soundPlaySampleChannel().
+///
+/// @return
+///     The index of the command in the batch, or -1 if the batch is full or it
+///     has already been submitted. Use the index with soundBatchGetResult() to
+///     get the channel used for the sound.
+int soundBatchPlaySample(SoundBatch *batch, int channel, const void *data,
+                         SoundFormat format, u32 dataSize, u16 freq, u8 volume,
+                         u8 pan, bool loop, u16 loopPoint);
+
+/// Adds a command to play a PSG tone to a batch.
+///
+/// The arguments are the same as in soundPlayPSGChannel().
+///
+/// @return
+///     The index of the command in the batch, or -1 on error.
+int soundBatchPlayPSG(SoundBatch *batch, int channel, DutyCycle cycle, u16 freq,
+                      u8 volume, u8 pan);
+
+/// Adds a command to play white noise to a batch.
+///
+/// The arguments are the same as in soundPlayNoiseChannel().
+///
+/// @return
+///     The index of the command in the batch, or -1 on error.
+int soundBatchPlayNoise(SoundBatch *batch, int channel, u16 freq, u8 volume,
+                        u8 pan);
+
+/// Adds a command to pause a sound to a batch.
+///
+/// @return
+///     The index of the command in the batch, or -1 on error.
+int soundBatchPause(SoundBatch *batch, int soundId);
+
+/// Adds a command to stop a sound to a batch.
+///
+/// @return
+///     The index of the command in the batch, or -1 on error.
+int soundBatchKill(SoundBatch *batch, int soundId);
+
+/// Adds a command to resume a sound to a batch.
+///
+/// @return
+///     The index of the command in the batch, or -1 on error.
+int soundBatchResume(SoundBatch *batch, int soundId);
+
+/// Adds a command to set the volume of a sound to a batch.
+///
+/// @return
+///     The index of the command in the batch, or -1 on error.
+int soundBatchSetVolume(SoundBatch *batch, int soundId, u8 volume);
+
+/// Adds a command to set the panning of a sound to a batch.
+///
+/// @return
+///     The index of the command in the batch, or -1 on error.
+int soundBatchSetPan(SoundBatch *batch, int soundId, u8 pan);
+
+/// Adds a command to set the frequency of a sound to a batch.
+///
+/// @return
+///     The index of the command in the batch, or -1 on error.
+int soundBatchSetFreq(SoundBatch *batch, int soundId, u16 freq);
+
+/// Sends a batch to the ARM7 without waiting for it to be applied.
+///
+/// No commands can be added to the batch until soundBatchReset() is called.
+///
+/// @param batch
+///     Batch to be sent.
+///
+/// @return
+///     It returns true on success, false on error.
+bool soundBatchSubmit(SoundBatch *batch);
+
+/// Checks if the ARM7 has applied all the commands of a batch.
+///
+/// @param batch
+///     Batch to check.
+///
+/// @return
+///     It returns true if the batch has been applied.
+bool soundBatchIsDone(const SoundBatch *batch);
+
+/// Waits until the ARM7 has applied all the commands of a batch.
+///
+/// The thread waits for the FIFO interrupt, so other cothreads can run while it
+/// waits, even if they have lower priority.
+///
+/// @param batch
+///     Batch to wait for.
+void soundBatchWait(const SoundBatch *batch);
+
+/// Gets the result of a command of a batch that has been applied.
+///
+/// @param batch
+///     Batch that contains the command.
+/// @param index
+///     Index returned when the command was added to the batch.
+///
+/// @return
+///     For commands that play a sound, the channel used to play it, or -1 if
+///     there were no free channels. For other commands, 0. If the batch hasn't
+///     been applied yet it returns -1.
+int soundBatchGetResult(SoundBatch *batch, int index);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,156 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#ifndef LIBNDS_NDS_ARM9_STORAGE_TRACE_H__
+#define LIBNDS_NDS_ARM9_STORAGE_TRACE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @file nds/arm9/storage_trace.h
+///
+/// @brief Tracing of storage device accesses.
+///
+/// When tracing is active, every command sent to a storage device (DLDI, the
+/// SD slot of the DSi and Slot-1 cartridge reads of NitroFS) is recorded in a
+/// ring buffer, and its duration is added to a latency histogram of the
+/// device. This is useful to find out why loading files is slow.
+///
+/// Durations and timestamps are measured with cpuGetTiming(), so the timers
+/// need to be started with cpuStartTiming() before tracing starts:
+///
+/// ```
+/// cpuStartTiming(0);
+/// storageTraceStart(1024);
+///
+/// load_level();
+///
+/// storageTraceStop();
+/// storageTraceDumpFile("fat:/trace.csv");
+/// storageTraceFree();
+/// ```
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <nds/ndstypes.h>
+
+/// Number of bins of the latency histograms.
+///
+/// Bin 0 counts commands that take less than 2 microseconds, bin N counts
+/// commands that take between 2^N and 2^(N+1) - 1 microseconds. The last bin
+/// also counts all commands that take longer than that.
+#define STORAGE_TRACE_HISTOGRAM_BINS    24
+
+/// Storage devices that can be traced.
+typedef enum
+{
+    STORAGE_TRACE_DEV_DLDI = 0, ///< DLDI driver (flashcard)
+    STORAGE_TRACE_DEV_SD   = 1, ///< SD slot of the DSi
+    STORAGE_TRACE_DEV_CARD = 2, ///< Slot-1 cartridge (NitroFS)
+
+    STORAGE_TRACE_NUM_DEVICES
+} StorageTraceDevice;
+
+/// Way used to access a device.
+typedef enum
+{
+    /// The device has transferred data directly to or from the user buffer.
+    STORAGE_TRACE_PATH_DIRECT = 0,
+    /// The user buffer can't be used by the device. The data has been
+    /// transferred one sector at a time through an intermediate buffer.
+    STORAGE_TRACE_PATH_BOUNCE = 1,
+    /// The sector wasn't in the sector cache and it has been read into it.
+    STORAGE_TRACE_PATH_CACHE  = 2,
+    /// The command has been sent to the ARM7 (Slot-1 reads).
+    STORAGE_TRACE_PATH_ARM7   = 3,
+} StorageTracePath;
+
+/// Record of a command sent to a storage device.
+typedef struct
+{
+    u32 timestamp; ///< Value of cpuGetTiming() when the command started
+    u32 duration;  ///< Duration of the command in ticks of cpuGetTiming()
+    u32 lba;       ///< First sector (byte offset for STORAGE_TRACE_DEV_CARD)
+    u32 count;     ///< Number of sectors (bytes for STORAGE_TRACE_DEV_CARD)
+    u8 device;     ///< A value of StorageTraceDevice
+    u8 path;       ///< A value of StorageTracePath
+    u8 write;      ///< 1 for writes, 0 for reads
+    u8 error;      ///< 1 if the command has failed
+} StorageTraceRecord;
+
+/// Starts recording storage commands.
+///
+/// It allocates a ring buffer for the records and clears the histograms. If
+/// the ring buffer is full, the oldest records are overwritten.
+///
+/// @param max_records
+///     Number of records that fit in the ring buffer.
+///
+/// @return
+///     Returns true on success, false if there isn't enough memory.
+bool storageTraceStart(size_t max_records);
+
+/// Stops recording storage commands.
+///
+/// The records and histograms are kept until storageTraceFree() is called or
+/// tracing is started again.
+void storageTraceStop(void);
+
+/// Frees the ring buffer used to store the records.
+void storageTraceFree(void);
+
+/// Returns the number of commands that have been recorded since tracing was
+/// started, including the ones that have been overwritten.
+///
+/// @return
+///     Number of commands.
+u32 storageTraceGetTotal(void);
+
+/// Copies the records in the ring buffer, from oldest to newest.
+///
+/// @param records
+///     Destination buffer.
+/// @param max_records
+///     Number of records that fit in the destination buffer.
+///
+/// @return
+///     Number of records copied.
+size_t storageTraceGetRecords(StorageTraceRecord *records, size_t max_records);
+
+/// Gets the latency histogram of a device.
+///
+/// @param device
+///     Device.
+/// @param write
+///     True to get the histogram of writes, false for reads.
+/// @param bins
+///     Destination of the STORAGE_TRACE_HISTOGRAM_BINS counters.
+///
+/// @return
+///     Returns true on success, false if the arguments aren't valid.
+bool storageTraceGetHistogram(StorageTraceDevice device, bool write,
+                              u32 bins[STORAGE_TRACE_HISTOGRAM_BINS]);
+
+/// Saves the records and histograms to a text file.
+///
+/// Records are saved as comma-separated values. Tracing is paused while the
+/// file is written so that the accesses to the file aren't recorded.
+///
+/// @param path
+///     Path to the file.
+///
+/// @return
+///     Returns true on success, false on error.
+bool storageTraceDumpFile(const char *path);
+
+/// Prints the records and histograms to the debug console of no$gba.
+void storageTraceDumpNocash(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBNDS_NDS_ARM9_STORAGE_TRACE_H__
@@ -21,10 +21,36 @@ extern "C" {
 
 /// Thread ID
 typedef int cothread_t;
-/// Mutex
-typedef int comutex_t;
+/// Mutex.
+///
+/// A mutex filled with zeroes is unlocked, so mutexes in static variables don't
+/// need to be initialized with comutex_init(). The fields are private.
+typedef struct
+{
+    uint32_t locked;
+    void *owner;
+    void *waiters;
+} comutex_t;
+/// Condition variable.
+///
+/// A condition variable filled with zeroes is ready to be used. The fields are
+/// private.
+typedef struct
+{
+    void *waiters;
+} cocond_t;
+/// Counting semaphore.
+///
+/// A semaphore filled with zeroes has a count of 0. The fields are private.
+typedef struct
+{
+    uint32_t count;
+    void *waiters;
+} cosema_t;
 /// Thread entrypoint
 typedef int (*cothread_entrypoint_t)(void *);
+/// Pool of preallocated thread stacks
+typedef struct cothread_pool cothread_pool_t;
 
 /// Flags a thread as detached.
 ///
@@ -32,6 +58,28 @@ typedef int (*cothread_entrypoint_t)(void *);
 /// cothread_has_joined() or cothread_get_exit_code() isn't allowed.
 #define COTHREAD_DETACHED   (1 << 0)
 
+/// Lowest priority of a thread.
+#define COTHREAD_PRIORITY_MIN       (-128)
+/// Priority of the main() thread, and default priority of new threads.
+#define COTHREAD_PRIORITY_DEFAULT   0
+/// Highest priority of a thread.
+#define COTHREAD_PRIORITY_MAX       127
+
+/// Sets the priority of a new thread when it's ORed to the flags passed to
+/// cothread_create() or cothread_create_manual().
+///
+/// The scheduler always resumes the thread with the highest priority of all the
+/// threads that aren't waiting for an interrupt. Threads with the same priority
+/// take turns. A thread with lower priority only runs when all threads with
+/// higher priority are waiting for an interrupt (for example, with
+/// cothread_yield_irq()), so threads with high priority shouldn't wait for
+/// other threads in a loop that calls cothread_yield(). They should use mutexes,
+/// condition variables or semaphores instead.
+///
+/// @param p
+///     Priority (COTHREAD_PRIORITY_MIN to COTHREAD_PRIORITY_MAX).
+#define COTHREAD_PRIORITY(p)    (((unsigned int)(p) & 0xFF) << 8)
+
 /// Creates a thread and allocate the stack for it.
 ///
 /// This stack will be freed when the thread is deleted.
@@ -48,7 +96,7 @@ typedef int (*cothread_entrypoint_t)(void *);
 ///     Size of the stack. If it is set to zero it will use a default value. If
 ///     non-zero, it must be aligned to 64 bit.
 /// @param flags
-///     Set of ORed flags (like COTHREAD_DETACHED) or 0.
+///     Set of ORed flags (like COTHREAD_DETACHED or COTHREAD_PRIORITY()) or 0.
 ///
 /// @return
 ///     On success, it returns a non-negative value representing the thread ID.
@@ -72,7 +120,7 @@ cothread_t cothread_create(cothread_entrypoint_t entrypoint, void *arg,
 /// @param stack_size
 ///     Size of the stack. Must be aligned to 64 bit.
 /// @param flags
-///     Set of ORed flags (like COTHREAD_DETACHED) or 0.
+///     Set of ORed flags (like COTHREAD_DETACHED or COTHREAD_PRIORITY()) or 0.
 ///
 /// @return
 ///     On success, it returns a non-negative value representing the thread ID.
@@ -81,6 +129,63 @@ cothread_t cothread_create_manual(cothread_entrypoint_t entrypoint, void *arg,
                                   void *stack_base, size_t stack_size,
                                   unsigned int flags);
 
+/// Creates a pool of preallocated resources for threads.
+///
+/// Creating a thread with cothread_create() allocates its stack, its control
+/// block and its thread-local storage with malloc(), and they are freed when
+/// the thread is deleted. Programs that create and delete a lot of short-lived
+/// threads can use a pool instead: all the memory is allocated once by this
+/// function, and threads created with cothread_create_pooled() take it from the
+/// pool and return it when they are deleted.
+///
+/// @param num_threads
+///     Maximum number of threads of the pool that can exist at the same time.
+/// @param stack_size
+///     Size of the stack of each thread. If it is set to zero it will use the
+///     same default value as cothread_create(). If non-zero, it must be aligned
+///     to 64 bit.
+///
+/// @return
+///     On success, it returns a pointer to the pool. On failure, it returns
+///     NULL and sets errno.
+cothread_pool_t *cothread_pool_create(size_t num_threads, size_t stack_size);
+
+/// Frees the memory of a pool.
+///
+/// All threads created from the pool must have been deleted before calling
+/// this function.
+///
+/// @param pool
+///     Pointer to the pool.
+///
+/// @return
+///     On success, it returns 0. On failure, it returns -1 and sets errno.
+int cothread_pool_destroy(cothread_pool_t *pool);
+
+/// Creates a thread using the resources of a pool.
+///
+/// It works like cothread_create(), but it doesn't allocate any memory. When
+/// the thread is deleted (or when it ends, if it is detached) its resources
+/// are returned to the pool.
+///
+/// @param pool
+///     Pointer to the pool.
+/// @param entrypoint
+///     Function to be run. The argument is the value of 'arg' passed to
+///     cothread_create_pooled().
+/// @param arg
+///     Argument to be passed to entrypoint.
+/// @param flags
+///     Set of ORed flags (like COTHREAD_DETACHED or COTHREAD_PRIORITY()) or 0.
+///
+/// @return
+///     On success, it returns a non-negative value representing the thread ID.
+///     On failure, it returns -1 and sets errno (EAGAIN if all the resources of
+///     the pool are being used).
+cothread_t cothread_create_pooled(cothread_pool_t *pool,
+                                  cothread_entrypoint_t entrypoint, void *arg,
+                                  unsigned int flags);
+
 /// Detach the specified thread.
 ///
 /// @param thread
@@ -132,6 +237,29 @@ int cothread_get_exit_code(cothread_t thread);
 ///     On success, it returns 0. On failure, it returns -1 and sets errno.
 int cothread_delete(cothread_t thread);
 
+/// Changes the priority of a thread.
+///
+/// @see COTHREAD_PRIORITY()
+///
+/// @param thread
+///     Thread ID.
+/// @param priority
+///     New priority (COTHREAD_PRIORITY_MIN to COTHREAD_PRIORITY_MAX).
+///
+/// @return
+///     On success, it returns 0. On failure, it returns -1 and sets errno.
+int cothread_set_priority(cothread_t thread, int priority);
+
+/// Returns the priority of a thread.
+///
+/// @param thread
+///     Thread ID.
+///
+/// @return
+///     On success, it returns the priority. On failure, it returns
+///     COTHREAD_PRIORITY_DEFAULT and sets errno.
+int cothread_get_priority(cothread_t thread);
+
 /// Tells the scheduler to switch to a different thread.
 ///
 /// This can also be called from main().
@@ -156,6 +284,47 @@ void cothread_yield_irq(uint32_t flags);
 void cothread_yield_irq_aux(uint32_t flags);
 #endif
 
+/// Hardware timer used by cothread_sleep_us() and cothread_sleep_ms() by
+/// default.
+#define COTHREAD_SLEEP_TIMER_DEFAULT    3
+
+/// Selects the hardware timer used by cothread_sleep_us() and
+/// cothread_sleep_ms().
+///
+/// The timer is only used while at least one thread is sleeping. Its interrupt
+/// handler is set when the first thread starts sleeping and removed when no
+/// thread is sleeping, so the application can only use the timer while no
+/// thread is sleeping. It can't be changed while any thread is sleeping.
+///
+/// @param timer
+///     Timer index (0 to 3).
+///
+/// @return
+///     On success, it returns 0. On failure, it returns -1 and sets errno.
+int cothread_set_sleep_timer(int timer);
+
+/// Makes the current thread sleep for the specified number of microseconds.
+///
+/// The scheduler doesn't resume the thread until the time has passed. If all
+/// threads are waiting, the CPU enters low power mode until the next interrupt,
+/// and a hardware timer generates an interrupt when the earliest sleep ends.
+///
+/// The resolution of the timer is around 2 microseconds.
+///
+/// @param usec
+///     Number of microseconds to sleep. If it is 0, this is the same as
+///     cothread_yield().
+void cothread_sleep_us(uint32_t usec);
+
+/// Makes the current thread sleep for the specified number of milliseconds.
+///
+/// @see cothread_sleep_us()
+///
+/// @param msec
+///     Number of milliseconds to sleep. If it is 0, this is the same as
+///     cothread_yield().
+void cothread_sleep_ms(uint32_t msec);
+
 /// Returns ID of the thread that is running currently.
 ///
 /// @return
@@ -171,7 +340,9 @@ cothread_t cothread_get_current(void);
 ///     It returns true if the mutex has been initialized, false if not.
 static inline bool comutex_init(comutex_t *mutex)
 {
-    *mutex = 0;
+    mutex->locked = 0;
+    mutex->owner = NULL;
+    mutex->waiters = NULL;
     return true;
 }
 
@@ -182,37 +353,103 @@ static inline bool comutex_init(comutex_t *mutex)
 ///
 /// @return
 ///     It returns true if the mutex has been acquired, false if not.
-static inline bool comutex_try_acquire(comutex_t *mutex)
-{
-    if (*mutex != 0)
-        return false;
+bool comutex_try_acquire(comutex_t *mutex);
 
-    *mutex = 1;
-    return true;
-}
+/// Waits until the mutex is available and acquires it.
+///
+/// If the mutex is locked, the thread is added to the wait queue of the mutex
+/// and the scheduler doesn't resume it until the mutex is passed to it by
+/// comutex_release(). Waiting threads with higher priority get the mutex first.
+///
+/// @param mutex
+///     Pointer to the mutex.
+void comutex_acquire(comutex_t *mutex);
 
-/// Waits in a loop until the mutex is available.
+/// Releases a mutex.
 ///
-/// The main body of the loop calls cothread_yield() after each try, so that
-/// other threads can take control of the CPU and eventually release the mutex.
+/// If there are threads waiting for the mutex, it is passed to one of them
+/// directly, so it can't be acquired by any other thread in the meantime.
 ///
 /// @param mutex
 ///     Pointer to the mutex.
-static inline void comutex_acquire(comutex_t *mutex)
+void comutex_release(comutex_t *mutex);
+
+/// Initializes a condition variable.
+///
+/// @param cond
+///     Pointer to the condition variable.
+static inline void cocond_init(cocond_t *cond)
 {
-    while (comutex_try_acquire(mutex) == false)
-        cothread_yield();
+    cond->waiters = NULL;
 }
 
-/// Releases a mutex.
+/// Releases a mutex and waits until the condition variable is signalled.
 ///
+/// The mutex is acquired again before returning. There are no spurious
+/// wake-ups, but the condition should still be checked in a loop because other
+/// threads may change it before this thread gets the mutex back.
+///
+/// @param cond
+///     Pointer to the condition variable.
 /// @param mutex
-///     Pointer to the mutex.
-static inline void comutex_release(comutex_t *mutex)
+///     Pointer to a mutex that has been acquired by the current thread.
+void cocond_wait(cocond_t *cond, comutex_t *mutex);
+
+/// Wakes up one of the threads waiting for a condition variable.
+///
+/// The thread with the highest priority is woken up. It can be called from an
+/// interrupt handler.
+///
+/// @param cond
+///     Pointer to the condition variable.
+void cocond_signal(cocond_t *cond);
+
+/// Wakes up all the threads waiting for a condition variable.
+///
+/// It can be called from an interrupt handler.
+///
+/// @param cond
+///     Pointer to the condition variable.
+void cocond_broadcast(cocond_t *cond);
+
+/// Initializes a semaphore.
+///
+/// @param sema
+///     Pointer to the semaphore.
+/// @param count
+///     Initial count.
+static inline void cosema_init(cosema_t *sema, uint32_t count)
 {
-    *mutex = 0;
+    sema->count = count;
+    sema->waiters = NULL;
 }
 
+/// Tries to decrement the count of a semaphore without blocking execution.
+///
+/// @param sema
+///     Pointer to the semaphore.
+///
+/// @return
+///     It returns true if the count has been decremented, false if it was 0.
+bool cosema_try_wait(cosema_t *sema);
+
+/// Waits until the count of a semaphore is greater than 0 and decrements it.
+///
+/// The thread isn't resumed by the scheduler while it waits.
+///
+/// @param sema
+///     Pointer to the semaphore.
+void cosema_wait(cosema_t *sema);
+
+/// Increments the count of a semaphore.
+///
+/// If there are threads waiting for the semaphore, the one with the highest
+/// priority is woken up instead. It can be called from an interrupt handler.
+///
+/// @param sema
+///     Pointer to the semaphore.
+void cosema_signal(cosema_t *sema);
+
 // Private thread information. It is private to the library, but exposed here
 // to make it possible to write tests for cothread. It extends __ndsabi_coro_t.
 typedef struct
@@ -231,6 +468,13 @@ typedef struct
     uint32_t wait_irq_aux_flags;
 #endif
     uint32_t flags;
+    int32_t priority;
+    uint32_t sleeping;
+    void *sleep_next;
+    uint64_t wake_time;
+    void *wait_queue; // If not NULL, the thread is blocked in this queue
+    void *wait_next;
+    void *pool; // If not NULL, the resources are returned to this pool
 } cothread_info_t;
 
 #ifdef __cplusplus
@@ -15,6 +15,8 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 #include <nds/bios.h>
 #include <nds/ndstypes.h>
 
@@ -35,13 +37,55 @@ typedef enum
     /// Run Length Encoding decompression.
     RLE,
     /// Run Length Encoding decompression (VRAM can be used as detination).
-    RLEVram
+    RLEVram,
+    /// LZ4 decompression.
+    LZ4,
+    /// LZ4 decompression (VRAM can be used as destination).
+    LZ4Vram
 } DecompressType;
 
+/// Implementations of the decompression routines that decompress() can use.
+typedef enum
+{
+    /// Use the routines of the BIOS.
+    DECOMPRESS_BACKEND_BIOS,
+    /// Use the software routines of libnds, which are faster than the ones of
+    /// the BIOS. In the ARM9 they are placed in ITCM. The output is the same as
+    /// the output of the BIOS routines. This is the default in the ARM9.
+    DECOMPRESS_BACKEND_SOFTWARE,
+} DecompressBackend;
+
+/// Selects the implementation of the decompression routines used by
+/// decompress().
+///
+/// The BIOS routines are the default in the ARM7. Formats that aren't supported
+/// by the BIOS always use the software routines.
+///
+/// @param backend
+///     The implementation to use.
+void decompressSetBackend(DecompressBackend backend);
+
+/// Returns the implementation of the decompression routines used by
+/// decompress().
+///
+/// @return
+///     The implementation in use.
+DecompressBackend decompressGetBackend(void);
+
 /// Decompresses data using the suported type.
 ///
+/// LZ77 and LZ77Vram support the format of the BIOS (type 0x10) and the
+/// extended format with longer matches (type 0x11).
+///
+/// LZ4 and LZ4Vram expect a header like the one of the BIOS formats, with type
+/// 0x40 and the decompressed size in the top 24 bits, followed by a LZ4 block
+/// (not a LZ4 frame). It compresses a bit worse than LZ77, but it is several
+/// times faster to decompress. It isn't supported by the BIOS, so it always
+/// uses the software routines.
+///
 /// When 'type' is HUFF, this function will allocate 512 bytes in the stack as a
-/// temporary buffer.
+/// temporary buffer for the BIOS routine, or 1 KB for the lookup table of the
+/// software routine.
 ///
 /// @param dst
 ///     Destination to decompress to.
@@ -54,7 +98,8 @@ void decompress(const void *data, void *dst, DecompressType type);
 /// Decompresses data using the suported type.
 ///
 /// Only LZ77Vram, HUFF and RLEVram support streaming, but HUFF isn't supported
-/// by this function at all, use decompressStreamStruct() instead.
+/// by this function at all, use decompressStreamStruct() instead. LZ4 and
+/// LZ4Vram don't support streaming.
 ///
 /// @param dst
 ///     Destination to decompress to.
@@ -90,6 +135,95 @@ void decompressStream(const void *data, void *dst, DecompressType type,
 void decompressStreamStruct(const void *data, void *dst, DecompressType type,
                             void *param, TDecompressionStream *ds);
 
+/// State of an incremental decompression.
+///
+/// The fields of this struct are internal, they shouldn't be used directly.
+typedef struct
+{
+    const uint8_t *src;  ///< Next byte of compressed data
+    uint8_t *dst;        ///< Start of the destination buffer
+    uint32_t size;       ///< Size of the decompressed data
+    uint32_t pos;        ///< Number of bytes decompressed so far
+    uint8_t type;        ///< DecompressType used for this decompression
+    uint8_t format;      ///< Type byte of the compression header
+    uint8_t flags;       ///< LZ77: Flags of the current block
+    uint8_t flag_count;  ///< LZ77: Number of flags left in the current block
+    uint32_t run_len;    ///< LZ77, RLE: Bytes left in the current run
+    uint32_t run_arg;    ///< LZ77: Displacement. RLE: Repeated byte or -1
+    uint32_t pending;    ///< Byte waiting to be written, or Huffman word
+    uint32_t last;       ///< Last byte decompressed
+    const uint8_t *tree; ///< Huffman: Root node of the tree
+    uint32_t bits;       ///< Huffman: Bits left in the current input word
+    uint32_t bit_count;  ///< Huffman: Number of bits left in "bits"
+    uint32_t out_bits;   ///< Huffman: Number of bits stored in "pending"
+} DecompressIncremental;
+
+/// Prepares the incremental decompression of a buffer.
+///
+/// Incremental decompression allows splitting the decompression of a big
+/// buffer in small steps, for example to decompress a few KB per frame without
+/// stopping the game. The output is the same as the output of decompress().
+///
+/// Only LZ77, LZ77Vram, HUFF, RLE and RLEVram are supported. LZ77 and LZ77Vram
+/// support types 0x10 and 0x11 like decompress(). The compressed data and the
+/// destination buffer must stay available until the decompression is done.
+///
+/// Example:
+///
+/// ```
+/// DecompressIncremental state;
+/// if (!decompressIncrementalInit(&state, data, dst, LZ77Vram))
+///     return;
+///
+/// while (!decompressIncrementalDone(&state))
+/// {
+///     decompressIncrementalStep(&state, 16 * 1024);
+///     swiWaitForVBlank();
+/// }
+/// ```
+///
+/// @param state
+///     State to be initialized.
+/// @param data
+///     Data to decompress.
+/// @param dst
+///     Destination to decompress to.
+/// @param type
+///     Type of data to decompress.
+///
+/// @return
+///     It returns true on success, false if the type or the header of the data
+///     aren't supported.
+bool decompressIncrementalInit(DecompressIncremental *state, const void *data,
+                               void *dst, DecompressType type);
+
+/// Decompresses the next part of a buffer.
+///
+/// Huffman data is written in 32-bit units, so the number of bytes
+/// decompressed may be up to 3 bytes bigger than requested.
+///
+/// @param state
+///     State initialized with decompressIncrementalInit().
+/// @param max_output_bytes
+///     Maximum number of bytes to decompress in this step.
+///
+/// @return
+///     Number of bytes decompressed in this step.
+size_t decompressIncrementalStep(DecompressIncremental *state,
+                                 size_t max_output_bytes);
+
+/// Checks if an incremental decompression has finished.
+///
+/// @param state
+///     State initialized with decompressIncrementalInit().
+///
+/// @return
+///     It returns true if all the data has been decompressed.
+static inline bool decompressIncrementalDone(const DecompressIncremental *state)
+{
+    return state->pos >= state->size;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -101,6 +101,14 @@ typedef struct DISC_INTERFACE_STRUCT
     FN_MEDIUM_SHUTDOWN      shutdown;
 } DISC_INTERFACE;
 
+/// Run of consecutive sectors and the buffer used to transfer them.
+typedef struct DISC_EXTENT_STRUCT
+{
+    sec_t sector;     ///< The first sector number.
+    sec_t numSectors; ///< The number of sectors.
+    void *buffer;     ///< The source or destination buffer.
+} DISC_EXTENT;
+
 /// Return the internal DSi SD card interface.
 const DISC_INTERFACE *get_io_dsisd(void);
 
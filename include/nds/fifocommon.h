@@ -45,6 +45,9 @@ typedef enum
     FIFO_SDMMC      = 5,  ///< Deprecated name of FIFO_STORAGE
 } FifoChannels;
 
+/// Number of FIFO channels.
+#define FIFO_NUM_CHANNELS       16
+
 /// Enum values for the FIFO sound commands (FIFO_SOUND).
 typedef enum
 {
@@ -75,6 +78,9 @@ typedef enum
     SYS_ARM7_ASSERTION,
     SYS_ARM7_CONSOLE_FLUSH,
     SYS_SET_ARM7_CONSOLE,
+    SYS_SET_INPUT_SHARED,
+    SYS_SET_TOUCH_SAMPLING,
+    SYS_TOUCH_SAMPLING_STOPPED,
 } FifoSystemCommands;
 
 /// SD, NAND and DLDI system commands (FIFO_STORAGE).
@@ -95,6 +101,9 @@ typedef enum
     DLDI_CLEAR_STATUS,
     DLDI_SHUTDOWN,
     SLOT1_CARD_READ,
+    SDMMC_QUEUE_DOORBELL,
+    DLDI_READ_SECTORS_LIST,
+    DLDI_WRITE_SECTORS_LIST,
 } FifoSdmmcCommands;
 
 /// System commands to access the firmware (FIFO_FIRMWARE).
@@ -177,8 +186,72 @@ typedef void (*FifoDatamsgHandlerFunc)(int num_bytes, void *userdata);
 ///
 /// @note
 ///     Call irqInit() before calling this function.
+///
+/// @note
+///     It uses a buffer of FIFO_BUFFER_DEFAULT_ENTRIES words to store messages
+///     while they are sent or handled. Use fifoInitWithBuffer() to provide a
+///     buffer of a different size.
 bool fifoInit(void);
 
+/// Number of words of the buffer used by fifoInit().
+#define FIFO_BUFFER_DEFAULT_ENTRIES     256
+
+/// Minimum number of words of the buffer of the FIFO system.
+#define FIFO_BUFFER_MIN_ENTRIES         64
+
+/// Maximum number of words of the buffer of the FIFO system.
+#define FIFO_BUFFER_MAX_ENTRIES         0xFFFF
+
+/// Size in bytes of a buffer of the FIFO system with the specified words.
+#define FIFO_BUFFER_BYTES(entries)      ((entries) * 8)
+
+/// Initializes the FIFO system with a user-provided buffer.
+///
+/// This works like fifoInit(), but the buffer used to store messages while they
+/// are sent or handled is provided by the caller. A bigger buffer makes it less
+/// likely for senders to wait for free space when a lot of messages are sent
+/// at once. A smaller buffer saves memory, which is useful in the ARM7. If
+/// fifoInit() isn't called, the default buffer isn't linked into the binary.
+///
+/// @param buffer
+///     Buffer of FIFO_BUFFER_BYTES(entries) bytes aligned to 4 bytes. It must
+///     stay available while the FIFO system is used.
+/// @param entries
+///     Number of words of the buffer (FIFO_BUFFER_MIN_ENTRIES to
+///     FIFO_BUFFER_MAX_ENTRIES).
+///
+/// @return
+///     Returns true on success, false on error.
+///
+/// @note
+///     Call irqInit() before calling this function.
+bool fifoInitWithBuffer(void *buffer, u32 entries);
+
+#ifdef ARM9
+
+/// Replaces the buffer of the FIFO system by a bigger one allocated in the heap.
+///
+/// Messages that are in the current buffer are copied to the new one. If the
+/// current buffer was allocated by this function, it's freed.
+///
+/// This must not be called from an interrupt handler.
+///
+/// @param entries
+///     New number of words of the buffer (up to FIFO_BUFFER_MAX_ENTRIES). If it
+///     isn't bigger than the current number of words, nothing is done.
+///
+/// @return
+///     Returns true on success, false if there isn't enough memory.
+bool fifoGrowBuffer(u32 entries);
+
+#endif
+
+/// Returns the number of words of the buffer of the FIFO system.
+///
+/// @return
+///     Number of words.
+u32 fifoGetBufferEntries(void);
+
 /// Sends a main RAM address to the other CPU.
 ///
 /// @param channel
@@ -459,6 +532,52 @@ static inline void fifoWaitDatamsgAsync(u32 channel)
     }
 }
 
+/// Statistics of one type of FIFO message in one channel.
+typedef struct
+{
+    u32 messages_sent;      ///< Number of messages sent
+    u32 bytes_sent;         ///< Number of bytes sent
+    u32 messages_received;  ///< Number of messages received
+    u32 bytes_received;     ///< Number of bytes received
+} FifoMessageStats;
+
+/// Statistics of the FIFO system of one CPU.
+///
+/// Durations are measured with cpuGetTiming(), so they are only recorded
+/// while the timers started by cpuStartTiming() are running.
+typedef struct
+{
+    FifoMessageStats address[FIFO_NUM_CHANNELS]; ///< Address messages of each channel
+    FifoMessageStats value32[FIFO_NUM_CHANNELS]; ///< Value32 messages of each channel
+    FifoMessageStats datamsg[FIFO_NUM_CHANNELS]; ///< Data messages of each channel
+
+    u32 buffer_entries;         ///< Number of words of the message buffer
+    u32 buffer_high_water;      ///< Maximum number of words used at once
+
+    u32 send_blocked_count;     ///< Times that a sender waited for free words
+    u32 send_blocked_ticks;     ///< Total time spent waiting for free words
+    u32 send_failed_count;      ///< Messages not sent due to lack of space
+
+    u32 rpc_completed;          ///< Number of fifoRpcSend() requests answered
+    u32 rpc_latency_total;      ///< Total time between requests and answers
+    u32 rpc_latency_max;        ///< Maximum time between a request and answer
+} FifoStats;
+
+/// Gets the statistics of the FIFO system of this CPU.
+///
+/// Statistics are only collected if libnds has been built with
+/// FIFO_ENABLE_STATS defined (run "make FIFO_STATS=1" to build it).
+///
+/// @param stats
+///     Pointer to a struct to store the statistics.
+///
+/// @return
+///     Returns true on success, false if statistics are disabled.
+bool fifoGetStats(FifoStats *stats);
+
+/// Sets all the statistics of the FIFO system of this CPU to zero.
+void fifoResetStats(void);
+
 #ifdef ARM9
 
 /// Acquires the mutex of the specified FIFO channel.
@@ -31,7 +31,10 @@ typedef enum {
     CAMERA_APT_READ_I2C,
     CAMERA_APT_WRITE_I2C,
     CAMERA_APT_READ_MCU,
-    CAMERA_APT_WRITE_MCU
+    CAMERA_APT_WRITE_MCU,
+    SOUND_BATCH_MESSAGE,
+    SOUND_COMMAND_MESSAGE,
+    SDMMC_QUEUE_SETUP
 } FifoMessageType;
 
 typedef struct FifoMessage {
@@ -104,6 +107,15 @@ typedef struct FifoMessage {
             u32 flags;
         } cardParams;
 
+        struct {
+            void *queue;
+        } sdQueueParams;
+
+        struct {
+            void *extents;
+            u32 count;
+        } dldiListParams;
+
         struct {
             void *buffer;
             u32 address;
@@ -119,6 +131,23 @@ typedef struct FifoMessage {
         struct {
             void *buffer;
         } setArm7Console;
+
+        struct {
+            void *block;
+        } setInputShared;
+
+        struct {
+            void *ring;
+            u32 rate;
+        } setTouchSampling;
+
+        struct {
+            void *batch;
+        } SoundBatch;
+
+        struct {
+            u32 command;
+        } SoundCommand;
     };
 
 } ALIGN(4) FifoMessage;
@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#ifndef LIBNDS_NDS_FIFORING_H__
+#define LIBNDS_NDS_FIFORING_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include <nds/ndstypes.h>
+
+/// @file nds/fiforing.h
+///
+/// @brief Shared memory ring buffers to send data between CPUs.
+///
+/// The FIFO system sends data to the other CPU one word at a time, and each
+/// message is copied twice: once to the queue of the sender, and once to the
+/// queue of the receiver. This is fine for small commands, but it's slow when
+/// a lot of data needs to be sent.
+///
+/// A ring is a buffer in main RAM with a read index and a write index. One CPU
+/// (the producer) writes data to it and the other CPU (the consumer) reads it.
+/// There are no locks, as each index is only modified by one of the CPUs. The
+/// FIFO system is only used to send a value32 message (the doorbell) to the
+/// consumer when the ring goes from empty to non-empty.
+///
+/// Example of a ring created by the ARM9 and consumed by the ARM7:
+///
+/// ```
+/// // ARM9
+/// void *mem = malloc(4096);
+/// FifoRing *ring = fifoRingInit(mem, 4096, FIFO_USER_01, 1);
+/// fifoRingSendAddress(FIFO_USER_01, ring);
+/// fifoRingWrite(ring, data, size);
+///
+/// // ARM7
+/// FifoRing *ring = fifoRingAttach(fifoGetAddress(FIFO_USER_01));
+/// fifoSetValue32Handler(FIFO_USER_01, doorbell_handler, NULL);
+///
+/// void doorbell_handler(u32 value32, void *userdata)
+/// {
+///     uint8_t buffer[64];
+///     size_t size;
+///     while ((size = fifoRingRead(ring, buffer, sizeof(buffer))) > 0)
+///         process(buffer, size);
+/// }
+/// ```
+///
+/// The consumer must read data until the ring is empty every time it receives
+/// the doorbell, or it may not receive the next one.
+
+/// Channel value for rings that don't send a doorbell to the consumer.
+///
+/// The consumer of this kind of rings needs to poll them.
+#define FIFO_RING_NO_DOORBELL   0xFFFFFFFF
+
+/// Header of a ring buffer shared between the ARM9 and the ARM7.
+///
+/// It is 32 bytes long so that the data is aligned to a cache line.
+typedef struct
+{
+    vu32 write_index; ///< Total number of bytes written. Modified by the producer.
+    vu32 read_index;  ///< Total number of bytes read. Modified by the consumer.
+    u32 size;         ///< Size of the data buffer in bytes (a power of two)
+    u32 channel;      ///< FIFO channel used to send the doorbell
+    u32 doorbell;     ///< Value32 sent to the consumer as doorbell
+    u32 reserved[3];  ///< Unused
+    u8 data[];        ///< Data buffer
+} FifoRing;
+
+/// Initializes a ring buffer in a block of memory.
+///
+/// The size of the data buffer is the biggest power of two that fits in the
+/// memory block after the header. In the ARM9, the memory block is flushed
+/// from the data cache, and the pointer returned by this function points to
+/// the uncached mirror of the block.
+///
+/// @param memory
+///     Memory block in main RAM aligned to 32 bytes.
+/// @param memory_size
+///     Size of the memory block.
+/// @param channel
+///     FIFO channel used to send the doorbell to the consumer, or
+///     FIFO_RING_NO_DOORBELL.
+/// @param doorbell
+///     Value32 sent to the consumer when the ring stops being empty.
+///
+/// @return
+///     Pointer to the ring, or NULL on error.
+FifoRing *fifoRingInit(void *memory, size_t memory_size, u32 channel,
+                       u32 doorbell);
+
+/// Sends the address of a ring to the other CPU.
+///
+/// The other CPU can get the address with fifoGetAddress() and pass it to
+/// fifoRingAttach().
+///
+/// @param channel
+///     Channel number.
+/// @param ring
+///     Pointer returned by fifoRingInit().
+///
+/// @return
+///     Returns true if the address has been sent, false on error.
+bool fifoRingSendAddress(u32 channel, FifoRing *ring);
+
+/// Gets a pointer to a ring created by the other CPU.
+///
+/// If the ARM7 creates a ring in memory provided by the ARM9, the ARM9 must
+/// flush that memory from the data cache before passing it to the ARM7.
+///
+/// @param address
+///     Address sent by the other CPU with fifoRingSendAddress().
+///
+/// @return
+///     Pointer to be used with the other functions of this file. In the ARM9 it
+///     points to the uncached mirror of the ring.
+FifoRing *fifoRingAttach(void *address);
+
+/// Writes data to a ring buffer.
+///
+/// Only the producer of the ring can call this function. The data is only
+/// written if there is enough space for all of it.
+///
+/// @param ring
+///     Pointer to the ring.
+/// @param data
+///     Data to be written.
+/// @param size
+///     Size of the data in bytes.
+///
+/// @return
+///     Returns true if the data has been written, false if there isn't enough
+///     space in the ring.
+bool fifoRingWrite(FifoRing *ring, const void *data, size_t size);
+
+/// Reads data from a ring buffer.
+///
+/// Only the consumer of the ring can call this function.
+///
+/// @param ring
+///     Pointer to the ring.
+/// @param data
+///     Destination buffer.
+/// @param size
+///     Size of the destination buffer in bytes.
+///
+/// @return
+///     Number of bytes read, which may be smaller than the requested size.
+size_t fifoRingRead(FifoRing *ring, void *data, size_t size);
+
+/// Returns the number of bytes that can be read from a ring buffer.
+///
+/// @param ring
+///     Pointer to the ring.
+///
+/// @return
+///     Number of bytes.
+static inline size_t fifoRingAvailable(const FifoRing *ring)
+{
+    return ring->write_index - ring->read_index;
+}
+
+/// Returns the number of bytes that can be written to a ring buffer.
+///
+/// @param ring
+///     Pointer to the ring.
+///
+/// @return
+///     Number of bytes.
+static inline size_t fifoRingFreeSpace(const FifoRing *ring)
+{
+    return ring->size - fifoRingAvailable(ring);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBNDS_NDS_FIFORING_H__
@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#ifndef LIBNDS_NDS_FIFORPC_H__
+#define LIBNDS_NDS_FIFORPC_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include <nds/ndstypes.h>
+
+/// @file nds/fiforpc.h
+///
+/// @brief Request/response messages between CPUs on top of the FIFO system.
+///
+/// The usual way to ask the other CPU to do something is to send a data
+/// message and wait for the next value32 message of the same channel. Only one
+/// request can be active in each channel at any time, and the channel needs to
+/// be locked with fifoMutexAcquire() while waiting for the answer.
+///
+/// This API gives each request an ID, and the answer of the other CPU carries
+/// the same ID. Many requests can be waiting for their answer at the same time,
+/// and the other CPU can answer them in any order.
+///
+/// Both CPUs need to call fifoRpcInit() with the same channel. The CPU that
+/// answers the requests passes a handler to it:
+///
+/// ```
+/// // ARM7
+/// void handler(u32 channel, u32 id, const void *request, size_t size,
+///              void *userdata)
+/// {
+///     u32 result = do_something(request, size);
+///     fifoRpcReply(channel, id, &result, sizeof(result));
+/// }
+///
+/// fifoRpcInit(FIFO_USER_01, handler, NULL);
+///
+/// // ARM9
+/// fifoRpcInit(FIFO_USER_01, NULL, NULL);
+///
+/// u32 result_a, result_b;
+/// FifoRpcRequest req_a, req_b;
+/// fifoRpcSend(FIFO_USER_01, &cmd_a, sizeof(cmd_a), &req_a,
+///             &result_a, sizeof(result_a));
+/// fifoRpcSend(FIFO_USER_01, &cmd_b, sizeof(cmd_b), &req_b,
+///             &result_b, sizeof(result_b));
+/// fifoRpcWait(&req_a);
+/// fifoRpcWait(&req_b);
+/// ```
+
+/// Maximum number of requests that can be waiting for an answer in each CPU.
+#define FIFO_RPC_MAX_PENDING    32
+
+/// Maximum size of the data of a request or an answer.
+#define FIFO_RPC_MAX_DATA_BYTES 120
+
+/// Callback that handles requests sent by the other CPU.
+///
+/// The handler must answer the request with fifoRpcReply(). It doesn't need to
+/// do it before returning, it can save the ID and answer it later.
+///
+/// @note
+///     Callback functions are called from an interrupt handler. Try to not use
+///     too much stack from the callback.
+typedef void (*FifoRpcHandlerFunc)(u32 channel, u32 id, const void *request,
+                                   size_t size, void *userdata);
+
+/// State of a request that is waiting for an answer.
+///
+/// It must stay available until the answer is received. The fields of this
+/// struct are internal, they shouldn't be used directly.
+typedef struct
+{
+    vu32 done;              ///< Set to 1 when the answer is received
+    u32 id;                 ///< ID of the request
+    void *response;         ///< Buffer for the answer
+    size_t response_size;   ///< Size of the buffer, then size of the answer
+    u32 start_time;         ///< Time when the request was sent
+} FifoRpcRequest;
+
+/// Sets up a FIFO channel to send and receive requests.
+///
+/// This function replaces the data message handler of the channel. Data
+/// messages that aren't requests or answers are ignored.
+///
+/// @param channel
+///     Channel number.
+/// @param handler
+///     Handler of requests sent by the other CPU. It can be NULL if this CPU
+///     only sends requests.
+/// @param userdata
+///     Value passed to the handler.
+///
+/// @return
+///     Returns true on success, false on error.
+bool fifoRpcInit(u32 channel, FifoRpcHandlerFunc handler, void *userdata);
+
+/// Sends a request to the other CPU without waiting for the answer.
+///
+/// @param channel
+///     Channel number.
+/// @param data
+///     Data of the request.
+/// @param size
+///     Size of the data (0 to FIFO_RPC_MAX_DATA_BYTES).
+/// @param req
+///     State of the request. It must stay available until the answer arrives.
+/// @param response
+///     Buffer for the answer. It can be NULL.
+/// @param response_size
+///     Size of the buffer. If the answer is bigger, the extra data is lost.
+///
+/// @return
+///     Returns true if the request has been sent. It returns false on error, or
+///     if there are already FIFO_RPC_MAX_PENDING requests waiting for answers.
+bool fifoRpcSend(u32 channel, const void *data, size_t size,
+                 FifoRpcRequest *req, void *response, size_t response_size);
+
+/// Answers a request sent by the other CPU.
+///
+/// @param channel
+///     Channel number.
+/// @param id
+///     ID of the request passed to the handler.
+/// @param data
+///     Data of the answer.
+/// @param size
+///     Size of the data (0 to FIFO_RPC_MAX_DATA_BYTES).
+///
+/// @return
+///     Returns true if the answer has been sent, false on error.
+bool fifoRpcReply(u32 channel, u32 id, const void *data, size_t size);
+
+/// Checks if a request has received its answer.
+///
+/// @param req
+///     State of the request.
+///
+/// @return
+///     Returns true if the answer has been received.
+static inline bool fifoRpcIsDone(const FifoRpcRequest *req)
+{
+    return req->done != 0;
+}
+
+/// Waits until a request receives its answer.
+///
+/// In the ARM9 it yields to other cothreads while it waits.
+///
+/// @param req
+///     State of the request.
+///
+/// @return
+///     Size of the answer.
+size_t fifoRpcWait(FifoRpcRequest *req);
+
+/// Sends a request to the other CPU and waits for the answer.
+///
+/// @param channel
+///     Channel number.
+/// @param data
+///     Data of the request.
+/// @param size
+///     Size of the data (0 to FIFO_RPC_MAX_DATA_BYTES).
+/// @param response
+///     Buffer for the answer. It can be NULL.
+/// @param response_size
+///     Size of the buffer.
+///
+/// @return
+///     Size of the answer, or -1 on error.
+int fifoRpcCall(u32 channel, const void *data, size_t size, void *response,
+                size_t response_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBNDS_NDS_FIFORPC_H__
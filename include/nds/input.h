@@ -12,6 +12,7 @@ extern "C" {
 #endif
 
 #include <nds/ndstypes.h>
+#include <nds/touch.h>
 
 /// @file nds/input.h
 ///
@@ -54,6 +55,15 @@ typedef enum KEYPAD_BITS
 #define KEYXY_TOUCH     BIT(6) ///< ARM7: Touchscreen pendown.
 #define KEYXY_LID       BIT(7) ///< ARM7: Lid state.
 
+/// Input state sampled by the ARM7.
+typedef struct InputSample
+{
+    u32 index;          ///< Number of the sample (it increases by one each time)
+    u16 vcount;         ///< Scanline (REG_VCOUNT) when the sample was taken
+    u16 keys;           ///< Keys that are pressed (KEYPAD_BITS)
+    touchPosition touch; ///< Touch screen state (only valid with KEY_TOUCH)
+} InputSample;
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,6 +29,21 @@ typedef struct touchPosition
     u16 z2;   ///< Raw cross panel resistance
 } touchPosition;
 
+/// Flag of TouchSample set when the pen has been lifted.
+#define TOUCH_SAMPLE_PEN_UP     BIT(0)
+
+/// Touch screen sample taken by the high-rate sampling mode.
+typedef struct TouchSample
+{
+    u32 tick;   ///< Number of sampling periods since sampling was started
+    u16 px;     ///< Processed pixel X value
+    u16 py;     ///< Processed pixel Y value
+    u16 rawx;   ///< Raw x value from the A2D
+    u16 rawy;   ///< Raw y value from the A2D
+    u16 vcount; ///< Scanline (REG_VCOUNT) when the sample was taken
+    u16 flags;  ///< TOUCH_SAMPLE_PEN_UP or 0
+} TouchSample;
+
 #ifdef __cplusplus
 }
 #endif
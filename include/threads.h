@@ -5,6 +5,8 @@
 #ifndef THREADS_H__
 #define THREADS_H__
 
+#include <time.h>
+
 #include <nds/cothread.h>
 
 // Partial implementation of C11 threads.h.
@@ -26,6 +28,7 @@ typedef void (*thrd_start_t)(void*);
 
 int thrd_create(thrd_t *thr, thrd_start_t func, void *arg);
 int thrd_join(thrd_t thr, int *res);
+int thrd_sleep(const struct timespec *duration, struct timespec *remaining);
 
 static inline thrd_t thrd_current(void)
 {
@@ -76,6 +79,19 @@ static inline int mtx_unlock(mtx_t *mtx)
     return thrd_success;
 }
 
+static inline void mtx_destroy(mtx_t *mtx)
+{
+    (void)mtx;
+}
+
+typedef cocond_t cnd_t;
+
+int cnd_init(cnd_t *cond);
+int cnd_signal(cnd_t *cond);
+int cnd_broadcast(cnd_t *cond);
+int cnd_wait(cnd_t *cond, mtx_t *mtx);
+void cnd_destroy(cnd_t *cond);
+
 #ifdef __cplusplus
 }
 #endif
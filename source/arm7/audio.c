@@ -57,19 +57,15 @@ void micSwapHandler(u8 *buffer, int length)
     fifoSendDatamsg(FIFO_SOUND, sizeof(msg), (u8 *)&msg);
 }
 
-void soundDataHandler(int bytes, void *user_data)
+// Starts playing a sample, PSG tone or noise. It returns the channel used, or -1
+// if the message isn't one of those or there are no free channels.
+static int soundPlayMessage(const FifoMessage *msg)
 {
-    (void)user_data;
-
     int channel = -1;
 
-    FifoMessage msg;
-
-    fifoGetDatamsg(FIFO_SOUND, bytes, (u8 *)&msg);
-
-    if (msg.type == SOUND_PLAY_MESSAGE)
+    if (msg->type == SOUND_PLAY_MESSAGE)
     {
-        channel = msg.SoundPlay.channel;
+        channel = msg->SoundPlay.channel;
 
         // If the user wants libnds to look for a free channel
         if (channel < 0)
@@ -81,19 +77,19 @@ void soundDataHandler(int bytes, void *user_data)
 
         if (channel >= 0)
         {
-            SCHANNEL_SOURCE(channel) = (u32)msg.SoundPlay.data;
-            SCHANNEL_REPEAT_POINT(channel) = msg.SoundPlay.loopPoint;
-            SCHANNEL_LENGTH(channel) = msg.SoundPlay.dataSize;
-            SCHANNEL_TIMER(channel) = SOUND_FREQ(msg.SoundPlay.freq);
-            SCHANNEL_CR(channel) = SCHANNEL_ENABLE | SOUND_VOL(msg.SoundPlay.volume)
-                                   | SOUND_PAN(msg.SoundPlay.pan)
-                                   | (msg.SoundPlay.format << 29)
-                                   | (msg.SoundPlay.loop ?  SOUND_REPEAT : SOUND_ONE_SHOT);
+            SCHANNEL_SOURCE(channel) = (u32)msg->SoundPlay.data;
+            SCHANNEL_REPEAT_POINT(channel) = msg->SoundPlay.loopPoint;
+            SCHANNEL_LENGTH(channel) = msg->SoundPlay.dataSize;
+            SCHANNEL_TIMER(channel) = SOUND_FREQ(msg->SoundPlay.freq);
+            SCHANNEL_CR(channel) = SCHANNEL_ENABLE | SOUND_VOL(msg->SoundPlay.volume)
+                                   | SOUND_PAN(msg->SoundPlay.pan)
+                                   | (msg->SoundPlay.format << 29)
+                                   | (msg->SoundPlay.loop ?  SOUND_REPEAT : SOUND_ONE_SHOT);
         }
     }
-    else if (msg.type == SOUND_PSG_MESSAGE)
+    else if (msg->type == SOUND_PSG_MESSAGE)
     {
-        channel = msg.SoundPsg.channel;
+        channel = msg->SoundPsg.channel;
 
         // If the user wants libnds to look for a free channel
         if (channel < 0)
@@ -105,15 +101,15 @@ void soundDataHandler(int bytes, void *user_data)
 
         if (channel >= 0)
         {
-            SCHANNEL_CR(channel) = SCHANNEL_ENABLE | msg.SoundPsg.volume
-                                   | SOUND_PAN(msg.SoundPsg.pan) | SOUND_FORMAT_PSG
-                                   | (msg.SoundPsg.dutyCycle << 24);
-            SCHANNEL_TIMER(channel) = SOUND_FREQ(msg.SoundPsg.freq);
+            SCHANNEL_CR(channel) = SCHANNEL_ENABLE | msg->SoundPsg.volume
+                                   | SOUND_PAN(msg->SoundPsg.pan) | SOUND_FORMAT_PSG
+                                   | (msg->SoundPsg.dutyCycle << 24);
+            SCHANNEL_TIMER(channel) = SOUND_FREQ(msg->SoundPsg.freq);
         }
     }
-    else if (msg.type == SOUND_NOISE_MESSAGE)
+    else if (msg->type == SOUND_NOISE_MESSAGE)
     {
-        channel = msg.SoundPsg.channel;
+        channel = msg->SoundPsg.channel;
 
         // If the user wants libnds to look for a free channel
         if (channel < 0)
@@ -125,10 +121,68 @@ void soundDataHandler(int bytes, void *user_data)
 
         if (channel >= 0)
         {
-            SCHANNEL_CR(channel) = SCHANNEL_ENABLE | msg.SoundPsg.volume
-                                   | SOUND_PAN(msg.SoundPsg.pan) | SOUND_FORMAT_PSG;
-            SCHANNEL_TIMER(channel) = SOUND_FREQ(msg.SoundPsg.freq);
+            SCHANNEL_CR(channel) = SCHANNEL_ENABLE | msg->SoundPsg.volume
+                                   | SOUND_PAN(msg->SoundPsg.pan) | SOUND_FORMAT_PSG;
+            SCHANNEL_TIMER(channel) = SOUND_FREQ(msg->SoundPsg.freq);
+        }
+    }
+
+    return channel;
+}
+
+void soundCommandHandler(u32 command, void *userdata);
+
+// Applies all the commands of a batch sent by the ARM9. Interrupts are disabled
+// so that all the commands take effect at the same time.
+static void soundBatchApply(SoundBatch *batch)
+{
+    s32 *results = soundBatchResults(batch);
+
+    int oldIME = enterCriticalSection();
+
+    for (u32 i = 0; i < batch->count; i++)
+    {
+        const FifoMessage *cmd = &batch->commands[i];
+
+        if (cmd->type == SOUND_COMMAND_MESSAGE)
+        {
+            soundCommandHandler(cmd->SoundCommand.command, NULL);
+            results[i] = 0;
         }
+        else
+        {
+            results[i] = soundPlayMessage(cmd);
+        }
+    }
+
+    batch->state = SOUND_BATCH_DONE;
+
+    leaveCriticalSection(oldIME);
+}
+
+void soundDataHandler(int bytes, void *user_data)
+{
+    (void)user_data;
+
+    int channel = -1;
+
+    FifoMessage msg;
+
+    fifoGetDatamsg(FIFO_SOUND, bytes, (u8 *)&msg);
+
+    if ((msg.type == SOUND_PLAY_MESSAGE) || (msg.type == SOUND_PSG_MESSAGE) ||
+        (msg.type == SOUND_NOISE_MESSAGE))
+    {
+        channel = soundPlayMessage(&msg);
+    }
+    else if (msg.type == SOUND_BATCH_MESSAGE)
+    {
+        // The ARM9 doesn't wait for an answer, it checks the state of the
+        // batch. The message is only sent to wake up threads that are waiting
+        // for the FIFO interrupt in soundBatchWait().
+        soundBatchApply(msg.SoundBatch.batch);
+        fifoSendDatamsg(FIFO_SOUND, sizeof(msg), (u8 *)&msg);
+        return;
     }
     else if (msg.type == SOUND_CAPTURE_START)
     {
@@ -12,9 +12,12 @@
 #include <nds/arm7/touch.h>
 #include <nds/fifocommon.h>
 #include <nds/fifomessages.h>
+#include <nds/fiforing.h>
+#include <nds/interrupts.h>
 #include <nds/ipc.h>
 #include <nds/ndstypes.h>
 #include <nds/system.h>
+#include <nds/timers.h>
 #include <nds/touch.h>
 
 // === Touchscreen filter configuration ===
@@ -143,6 +146,102 @@ noPenDown:
     }
 }
 
+// === High-rate touch sampling ===
+
+// Timer used to read the touch screen in the high-rate sampling mode
+#define TOUCH_SAMPLING_TIMER 2
+
+static FifoRing *touchSamplingRing = NULL;
+static u32 touchSamplingTick;
+static bool touchSamplingPenDown;
+
+// Reads and filters one touch screen sample. Unlike inputTouchUpdate(), there
+// is no debouncing or IIR filter, so that the trace follows the pen closely.
+static bool touchSamplingReadOne(TouchSample *sample)
+{
+    if (!touchPenDown())
+        return false;
+
+    touchRawArray data;
+    if (!touchReadData(&data))
+        return false;
+
+    libnds_touchMeasurementFilterResult rawXresult = libnds_touchMeasurementFilter(data.rawX);
+    if (!rawXresult.value)
+        return false;
+    libnds_touchMeasurementFilterResult rawYresult = libnds_touchMeasurementFilter(data.rawY);
+    if (!rawYresult.value)
+        return false;
+
+    u16 noisiness = rawXresult.noisiness > rawYresult.noisiness ? rawXresult.noisiness : rawYresult.noisiness;
+    if (noisiness > (touchSamplingPenDown ? TOUCH_MAX_NOISE_PEN_UP : TOUCH_MAX_NOISE_PEN_DOWN))
+        return false;
+
+    sample->rawx = rawXresult.value;
+    sample->rawy = rawYresult.value;
+    touchApplyCalibration(sample->rawx, sample->rawy, &sample->px, &sample->py);
+    sample->flags = 0;
+
+    return true;
+}
+
+static void touchSamplingTimerHandler(void)
+{
+    TouchSample sample;
+
+    touchSamplingTick++;
+
+    if (touchSamplingReadOne(&sample))
+    {
+        touchSamplingPenDown = true;
+    }
+    else
+    {
+        // Only send one sample when the pen is lifted
+        if (!touchSamplingPenDown)
+            return;
+
+        touchSamplingPenDown = false;
+
+        sample.px = sample.py = 0;
+        sample.rawx = sample.rawy = 0;
+        sample.flags = TOUCH_SAMPLE_PEN_UP;
+    }
+
+    sample.tick = touchSamplingTick;
+    sample.vcount = REG_VCOUNT;
+
+    // The ring may be removed by the FIFO interrupt handler while the touch
+    // screen is being read, so it needs to be checked with interrupts disabled.
+    int oldIME = enterCriticalSection();
+
+    if (touchSamplingRing != NULL)
+        fifoRingWrite(touchSamplingRing, &sample, sizeof(sample));
+
+    leaveCriticalSection(oldIME);
+}
+
+void inputSetTouchSampling(void *ring, u32 rate_hz)
+{
+    if (ring == NULL)
+    {
+        timerStop(TOUCH_SAMPLING_TIMER);
+        irqDisable(IRQ_TIMER(TOUCH_SAMPLING_TIMER));
+        touchSamplingRing = NULL;
+
+        // Let the ARM9 know that it can free the ring
+        fifoSendValue32(FIFO_SYSTEM, SYS_TOUCH_SAMPLING_STOPPED);
+        return;
+    }
+
+    touchSamplingRing = fifoRingAttach(ring);
+    touchSamplingTick = 0;
+    touchSamplingPenDown = false;
+
+    timerStart(TOUCH_SAMPLING_TIMER, ClockDivider_64, TIMER_FREQ_64(rate_hz),
+               touchSamplingTimerHandler);
+}
+
 // === Input updates ===
 
 // Sleep if lid has been closed for a specified number of frames
@@ -172,6 +271,44 @@ static void inputSleepUpdate(u16 keys)
     }
 }
 
+// Block in main RAM provided by the ARM9. If it isn't NULL, the input state is
+// written to it instead of being sent with a FIFO message.
+static InputSharedBlock *inputSharedBlock = NULL;
+
+void inputSetSharedBlock(InputSharedBlock *block)
+{
+    inputSharedBlock = block;
+}
+
+static void inputPublishShared(InputSharedBlock *block, u16 keys,
+                               const touchPosition *touch)
+{
+    int oldIME = enterCriticalSection();
+
+    u32 index = block->count;
+    InputSharedSample *sample =
+        &block->history[index & (INPUT_SHARED_HISTORY_SIZE - 1)];
+
+    // The sequence counter is odd while the block is being updated. Only the
+    // counter is volatile, so the compiler must be prevented from moving the
+    // writes to the rest of the block before or after it.
+    block->sequence++;
+    asm volatile("" ::: "memory");
+
+    sample->index = index;
+    sample->vcount = REG_VCOUNT;
+    sample->keyinput = REG_KEYINPUT;
+    sample->keyxy = keys;
+    sample->touch = *touch;
+
+    block->count = index + 1;
+
+    asm volatile("" ::: "memory");
+    block->sequence++;
+
+    leaveCriticalSection(oldIME);
+}
+
 void inputGetAndSend(void)
 {
     FifoMessage msg = {0};
@@ -180,6 +317,13 @@ void inputGetAndSend(void)
     keys |= inputTouchUpdate(&msg.SystemInput.touch);
     inputSleepUpdate(keys);
 
+    InputSharedBlock *block = inputSharedBlock;
+    if (block != NULL)
+    {
+        inputPublishShared(block, keys, &msg.SystemInput.touch);
+        return;
+    }
+
     msg.SystemInput.keys = keys;
     msg.type = SYS_INPUT_MESSAGE;
     fifoSendDatamsg(FIFO_SYSTEM, sizeof(msg), (u8 *)&msg);
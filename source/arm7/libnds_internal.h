@@ -29,6 +29,9 @@ libnds_touchMeasurementFilterResult libnds_touchMeasurementFilter(u16 values[5])
 
 int consoleSetup(ConsoleArm7Ipc *c);
 
+void inputSetSharedBlock(InputSharedBlock *block);
+void inputSetTouchSampling(void *ring, u32 rate_hz);
+
 bool twlSoundExtSetFrequency(unsigned int freq_khz);
 
 #endif // ARM7_LIBNDS_INTERNAL_H__
@@ -52,6 +52,7 @@ typedef struct
                    // bit 2 permanent write protection (CSD) and bit 3 password protection.
     u16 rca;       // Relative Card Address (RCA).
     u16 ccc;       // (e)MMC/SD command class support from CSD. One per bit starting at 0.
+    u8 highSpeed;  // 1 = High Speed mode supported.
     u32 sectors;   // Size in 512 byte units.
     u32 status;    // R1 card status on error. Only updated on errors.
 
@@ -311,6 +312,53 @@ static u32 initStandbyState(SdmmcDev *const dev, const u8 devType, const u32 rca
     return SDMMC_ERR_NONE;
 }
 
+// Checks with CMD6 (SWITCH_FUNC) in check mode if an SD card supports High
+// Speed mode. The card isn't switched to it.
+static bool sdSupportsHighSpeed(SdmmcDev *const dev)
+{
+    TmioPort *const port = &dev->port;
+
+    // CMD6 is part of command class 10. Cards older than SD 1.10 don't have it.
+    if (!(dev->ccc & (1u << 10)))
+        return false;
+
+    // The switch function status is 512 bits long. The bits are stored MSB
+    // first, so bit N is in byte (511 - N) / 8.
+    alignas(4) u8 status[64];
+    bool ok = false;
+
+    TMIO_setBlockLen(port, 64);
+
+    do
+    {
+        // Check if function 1 (High Speed) of group 1 (Access Mode) is
+        // supported. Bits [415:400] are the functions supported by group 1.
+        TMIO_setBuffer(port, (u32 *)status, 1);
+        u32 res = TMIO_sendCommand(port, SD_SWITCH_FUNC,
+                                   SD_SWITCH_FUNC_ARG(0, 0xF, 0xF, 0xF, 1));
+        if (res != 0 || !(status[13] & (1u << 1)))
+            break;
+
+        // Bits [379:376] are the function that would be selected in group 1
+        if ((status[16] & 0xFu) != 1)
+            break;
+
+        ok = true;
+    } while (0);
+
+    TMIO_setBlockLen(port, 512);
+
+    return ok;
+}
+
+// Checks in the EXT_CSD if an (e)MMC supports High Speed timing. HS_TIMING
+// isn't set.
+static bool mmcSupportsHighSpeed(const u8 *const ext_csd)
+{
+    // Bit 0: High Speed at 26 MHz. Bit 1: High Speed at 52 MHz.
+    return (ext_csd[EXT_CSD_CARD_TYPE] & 3u) != 0;
+}
+
 // TODO: Set the timeout based on clock speed (Tmio uses SDCLK for timeouts).
 //       The tmio driver sets a sane default but we should calculate it anyway.
 static u32 initTranState(SdmmcDev *const dev, const u8 devType, const u32 rca,
@@ -339,16 +387,16 @@ static u32 initTranState(SdmmcDev *const dev, const u8 devType, const u32 rca,
             // We should also check in the EXT_CSD the power budget for the card.
             // Nintendo seems to leave it on default (no change).
 
+            // Note: The EXT_CSD is normally read before touching HS timing and bus width.
+            //       We can take advantage of the faster data transfer with this order.
+            alignas(4) u8 ext_csd[512];
+            TMIO_setBuffer(port, (u32 *)ext_csd, 1);
+            res = TMIO_sendCommand(port, MMC_SEND_EXT_CSD, 0);
+            if (res != 0)
+                return SDMMC_ERR_SEND_EXT_CSD;
+
             if (devType == DEV_TYPE_MMCHC)
             {
-                // Note: The EXT_CSD is normally read before touching HS timing and bus width.
-                //       We can take advantage of the faster data transfer with this order.
-                alignas(4) u8 ext_csd[512];
-                TMIO_setBuffer(port, (u32 *)ext_csd, 1);
-                res = TMIO_sendCommand(port, MMC_SEND_EXT_CSD, 0);
-                if (res != 0)
-                    return SDMMC_ERR_SEND_EXT_CSD;
-
                 // Get sector count from EXT_CSD only if sector addressing is used because
                 // byte addressed (e)MMC may set sector count to 0.
                 dev->sectors = ext_csd[EXT_CSD_SEC_COUNT + 3] << 24 |
@@ -356,6 +404,8 @@ static u32 initTranState(SdmmcDev *const dev, const u8 devType, const u32 rca,
                                ext_csd[EXT_CSD_SEC_COUNT + 1] << 8 |
                                ext_csd[EXT_CSD_SEC_COUNT + 0];
             }
+
+            dev->highSpeed = mmcSupportsHighSpeed(ext_csd);
         }
     }
     else // SD card.
@@ -370,8 +420,15 @@ static u32 initTranState(SdmmcDev *const dev, const u8 devType, const u32 rca,
         if (res != 0)
             return SDMMC_ERR_SET_BUS_WIDTH;
         TMIO_setBusWidth(port, 4);
+
+        dev->highSpeed = sdSupportsHighSpeed(dev);
     }
 
+    // High Speed mode is only detected, the device isn't switched to it. The
+    // controller can't clock the bus over TMIO_HCLK / 2 (about 16.76 MHz),
+    // which is already below the 20 MHz of the default speed mode. Switching
+    // would add risk and init time without making transfers any faster.
+
     // SD:     The description for CMD SET_BLOCKLEN says 512 bytes is the default.
     // (e)MMC: The description for READ_BL_LEN (CSD) says 512 bytes is the default.
     // So it's not required to set the block length.
@@ -634,6 +691,7 @@ u32 SDMMC_getDevInfo(const u8 devNum, SdmmcInfo *const infoOut)
     memcpy(infoOut->cid, dev->cid, 16);
     infoOut->ccc      = dev->ccc;
     infoOut->busWidth = (port->sd_option & SD_OPTION_BUS_WIDTH1 ? 1 : 4);
+    infoOut->highSpeed = dev->highSpeed;
 
     return SDMMC_ERR_NONE;
 }
@@ -748,9 +806,37 @@ u32 SDMMC_writeSectors(const u8 devNum, u32 sect, const void *const buf, const u
     if (dev->prot != 0)
         return SDMMC_ERR_WRITE_PROT;
 
-    // Set source buffer and sector count.
     TmioPort *const port = &dev->port;
+
+    // Tell the card how many blocks are coming so that it can prepare them.
+    // SD cards pre-erase the blocks (SET_WR_BLK_ERASE_COUNT). The transfer is
+    // still ended with STOP_TRANSMISSION. (e)MMC uses a transfer with a
+    // predefined number of blocks (SET_BLOCK_COUNT), which doesn't need
+    // STOP_TRANSMISSION.
+    bool closedEnded = false;
+    if (count > 1)
+    {
+        u32 res;
+        if (IS_DEV_MMC(devType))
+        {
+            closedEnded = true;
+            res = TMIO_sendCommand(port, MMC_SET_BLOCK_COUNT, count);
+        }
+        else
+        {
+            res = sendAppCmd(port, SD_APP_SET_WR_BLK_ERASE_COUNT, count, (u32)dev->rca << 16);
+        }
+
+        if (res != 0)
+        {
+            updateStatus(dev, false);
+            return SDMMC_ERR_SECT_RW;
+        }
+    }
+
+    // Set source buffer and sector count.
     TMIO_setBuffer(port, (void *)buf, count);
+    TMIO_setAutoStop(port, !closedEnded);
 
     // Write a single 512 bytes block. Same CMD for (e)MMC/SD.
     // Write multiple 512 bytes blocks. Same CMD for (e)MMC/SD.
@@ -759,6 +845,7 @@ u32 SDMMC_writeSectors(const u8 devNum, u32 sect, const void *const buf, const u
         sect *= 512; // Byte addressing.
 
     const u32 res = TMIO_sendCommand(port, writeCmd, sect);
+    TMIO_setAutoStop(port, true);
     if (res != 0)
     {
         // On error in the middle of multi-block writes the card will be stuck
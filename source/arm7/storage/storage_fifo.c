@@ -16,6 +16,7 @@ static const DISC_INTERFACE *dldi_io = NULL;
 
 int sdmmcMsgHandler(int bytes, void *user_data, FifoMessage *msg);
 int sdmmcValueHandler(u32 value, void *user_data);
+void sdmmcQueueProcess(void);
 
 static void fifoIrqDisable(void)
 {
@@ -46,6 +47,7 @@ void storageMsgHandler(int bytes, void *user_data)
         case SDMMC_SD_WRITE_SECTORS:
         case SDMMC_NAND_READ_SECTORS:
         case SDMMC_NAND_WRITE_SECTORS:
+        case SDMMC_QUEUE_SETUP:
             if (isDSiMode())
                 retval = sdmmcMsgHandler(bytes, user_data, &msg);
             break;
@@ -83,6 +85,37 @@ void storageMsgHandler(int bytes, void *user_data)
                 libndsCrash("Write with no DLDI");
             }
             break;
+        case DLDI_READ_SECTORS_LIST:
+        case DLDI_WRITE_SECTORS_LIST:
+            if (dldi_io)
+            {
+                const DISC_EXTENT *extents = msg.dldiListParams.extents;
+
+                // Handle all extents without waiting for the ARM9. Stop at
+                // the first error.
+                retval = 1;
+                for (u32 i = 0; (i < msg.dldiListParams.count) && retval; i++)
+                {
+                    if (msg.type == DLDI_READ_SECTORS_LIST)
+                    {
+                        retval = dldi_io->readSectors(extents[i].sector,
+                                                      extents[i].numSectors,
+                                                      extents[i].buffer);
+                    }
+                    else
+                    {
+                        retval = dldi_io->writeSectors(extents[i].sector,
+                                                       extents[i].numSectors,
+                                                       extents[i].buffer);
+                    }
+                }
+            }
+            else
+            {
+                libndsCrash("List with no DLDI");
+            }
+            break;
+
         case SLOT1_CARD_READ:
             cardRead(msg.cardParams.buffer,
                      msg.cardParams.offset,
@@ -101,6 +134,19 @@ void storageValueHandler(u32 value, void *user_data)
 {
     int result = 0;
 
+    // The ARM9 doesn't expect an answer to the doorbell of the queue. The
+    // result of each request is written to shared memory.
+    if (value == SDMMC_QUEUE_DOORBELL)
+    {
+        if (isDSiMode())
+        {
+            fifoIrqDisable();
+            sdmmcQueueProcess();
+            fifoIrqEnable();
+        }
+        return;
+    }
+
     fifoIrqDisable();
 
     switch (value)
@@ -8,50 +8,240 @@
 #include <nds/ndma.h>
 #include <nds/fifocommon.h>
 #include <nds/fifomessages.h>
+#include <nds/fiforing.h>
+
+#include "common/libnds_internal.h"
 
 #define NDMA_CHANNEL 1
 
+#ifdef NDMA_CHANNEL
+
+// NDMA can only access buffers aligned to 4 bytes. Unaligned buffers are
+// transferred in chunks through this buffer, which is faster than letting the
+// TMIO driver copy one byte at a time with the CPU.
+#define SDMMC_BOUNCE_SECTORS 8
+
+static u32 sdmmcBounce[SDMMC_BOUNCE_SECTORS * 512 / 4] TWL_BSS ALIGN(32);
+
+// Copies words from an aligned buffer to an unaligned buffer. The size must be
+// a multiple of 4.
+ARM_CODE static void sdmmcCopyToUnaligned(u8 *dst, const u32 *src, u32 size)
+{
+    u32 shift = ((uintptr_t)dst & 3) * 8;
+
+    // Write bytes until the destination is aligned. Then, each word of the
+    // destination is formed by the end of one source word and the start of
+    // the next one.
+    u32 word = *src++;
+    u32 head = 4 - (shift / 8);
+    for (u32 i = 0; i < head; i++)
+    {
+        *dst++ = word;
+        word >>= 8;
+    }
+
+    u32 *out = (u32 *)dst;
+    u32 words = (size / 4) - 1;
+    while (words--)
+    {
+        u32 next = *src++;
+        *out++ = word | (next << shift);
+        word = next >> (32 - shift);
+    }
+
+    // Leftover bytes of the last source word
+    dst = (u8 *)out;
+    for (u32 i = 0; i < 4 - head; i++)
+    {
+        *dst++ = word;
+        word >>= 8;
+    }
+}
+
+// Copies words from an unaligned buffer to an aligned buffer. The size must be
+// a multiple of 4.
+ARM_CODE static void sdmmcCopyFromUnaligned(u32 *dst, const u8 *src, u32 size)
+{
+    u32 shift = ((uintptr_t)src & 3) * 8;
+
+    // Read aligned words. The bytes before and after the buffer are in the same
+    // words as bytes of the buffer, so this doesn't read from other regions.
+    const u32 *in = (const u32 *)((uintptr_t)src & ~3);
+    u32 word = *in++ >> shift;
+
+    u32 words = size / 4;
+    while (words--)
+    {
+        u32 next = *in++;
+        *dst++ = word | (next << (32 - shift));
+        word = next >> shift;
+    }
+}
+
+static u32 sdmmcReadSectorsNdma(const u8 devNum, u32 sect, void *buf, u32 count)
+{
+    NDMA_SRC(NDMA_CHANNEL) = (u32) getTmioFifo(getTmioRegs(0));
+    NDMA_DEST(NDMA_CHANNEL) = (u32) buf;
+    NDMA_BLENGTH(NDMA_CHANNEL) = 512 / 4;
+    NDMA_BDELAY(NDMA_CHANNEL) = NDMA_BDELAY_DIV_1 | NDMA_BDELAY_CYCLES(0);
+    NDMA_CR(NDMA_CHANNEL) = NDMA_ENABLE | NDMA_REPEAT | NDMA_BLOCK_SCALER(4)
+                            | NDMA_SRC_FIX | NDMA_DST_INC | NDMA_START_SDMMC;
+    u32 result = SDMMC_readSectors(devNum, sect, NULL, count);
+    NDMA_CR(NDMA_CHANNEL) = 0;
+    return result;
+}
+
+static u32 sdmmcWriteSectorsNdma(const u8 devNum, u32 sect, const void *buf, u32 count)
+{
+    NDMA_SRC(NDMA_CHANNEL) = (u32) buf;
+    NDMA_DEST(NDMA_CHANNEL) = (u32) getTmioFifo(getTmioRegs(0));
+    NDMA_BLENGTH(NDMA_CHANNEL) = 512 / 4;
+    NDMA_BDELAY(NDMA_CHANNEL) = NDMA_BDELAY_DIV_1 | NDMA_BDELAY_CYCLES(0);
+    NDMA_CR(NDMA_CHANNEL) = NDMA_ENABLE | NDMA_REPEAT | NDMA_BLOCK_SCALER(4)
+                            | NDMA_SRC_INC | NDMA_DST_FIX | NDMA_START_SDMMC;
+    u32 result = SDMMC_writeSectors(devNum, sect, NULL, count);
+    NDMA_CR(NDMA_CHANNEL) = 0;
+    return result;
+}
+
+#endif // NDMA_CHANNEL
+
 static u32 sdmmcReadSectors(const u8 devNum, u32 sect, u8 *buf, u32 count)
 {
 #ifdef NDMA_CHANNEL
     if (!(((uintptr_t) buf) & 0x3))
+        return sdmmcReadSectorsNdma(devNum, sect, buf, count);
+
+    while (count > 0)
     {
-        NDMA_SRC(NDMA_CHANNEL) = (u32) getTmioFifo(getTmioRegs(0));
-        NDMA_DEST(NDMA_CHANNEL) = (u32) buf;
-        NDMA_BLENGTH(NDMA_CHANNEL) = 512 / 4;
-        NDMA_BDELAY(NDMA_CHANNEL) = NDMA_BDELAY_DIV_1 | NDMA_BDELAY_CYCLES(0);
-        NDMA_CR(NDMA_CHANNEL) = NDMA_ENABLE | NDMA_REPEAT | NDMA_BLOCK_SCALER(4)
-                                | NDMA_SRC_FIX | NDMA_DST_INC | NDMA_START_SDMMC;
-        u32 result = SDMMC_readSectors(devNum, sect, NULL, count);
-        NDMA_CR(NDMA_CHANNEL) = 0;
-        return result;
+        u32 chunk = count > SDMMC_BOUNCE_SECTORS ? SDMMC_BOUNCE_SECTORS : count;
+
+        u32 result = sdmmcReadSectorsNdma(devNum, sect, sdmmcBounce, chunk);
+        if (result != 0)
+            return result;
+
+        sdmmcCopyToUnaligned(buf, sdmmcBounce, chunk * 512);
+
+        buf += chunk * 512;
+        sect += chunk;
+        count -= chunk;
     }
-    else
+
+    return 0;
+#else
+    return SDMMC_readSectors(devNum, sect, buf, count);
 #endif
-    {
-        return SDMMC_readSectors(devNum, sect, buf, count);
-    }
 }
 
 static u32 sdmmcWriteSectors(const u8 devNum, u32 sect, const u8 *buf, u32 count)
 {
 #ifdef NDMA_CHANNEL
     if (!(((uintptr_t) buf) & 0x3))
+        return sdmmcWriteSectorsNdma(devNum, sect, buf, count);
+
+    while (count > 0)
     {
-        NDMA_SRC(NDMA_CHANNEL) = (u32) buf;
-        NDMA_DEST(NDMA_CHANNEL) = (u32) getTmioFifo(getTmioRegs(0));
-        NDMA_BLENGTH(NDMA_CHANNEL) = 512 / 4;
-        NDMA_BDELAY(NDMA_CHANNEL) = NDMA_BDELAY_DIV_1 | NDMA_BDELAY_CYCLES(0);
-        NDMA_CR(NDMA_CHANNEL) = NDMA_ENABLE | NDMA_REPEAT | NDMA_BLOCK_SCALER(4)
-                                | NDMA_SRC_INC | NDMA_DST_FIX | NDMA_START_SDMMC;
-        u32 result = SDMMC_writeSectors(devNum, sect, NULL, count);
-        NDMA_CR(NDMA_CHANNEL) = 0;
-        return result;
+        u32 chunk = count > SDMMC_BOUNCE_SECTORS ? SDMMC_BOUNCE_SECTORS : count;
+
+        sdmmcCopyFromUnaligned(sdmmcBounce, buf, chunk * 512);
+
+        u32 result = sdmmcWriteSectorsNdma(devNum, sect, sdmmcBounce, chunk);
+        if (result != 0)
+            return result;
+
+        buf += chunk * 512;
+        sect += chunk;
+        count -= chunk;
     }
-    else
+
+    return 0;
+#else
+    return SDMMC_writeSectors(devNum, sect, buf, count);
 #endif
+}
+
+// Queue of requests shared with the ARM9
+static SdmmcQueueShared *sdmmcQueue = NULL;
+static FifoRing *sdmmcQueueRing = NULL;
+
+static void sdmmcQueueSetup(void *queue)
+{
+    sdmmcQueue = queue;
+
+    if (queue == NULL)
+        sdmmcQueueRing = NULL;
+    else
+        sdmmcQueueRing = fifoRingAttach((u8 *)queue + sizeof(SdmmcQueueShared));
+}
+
+// Returns true if a request continues the transfer of the previous one
+static bool sdmmcQueueIsAdjacent(const SdmmcQueueEntry *prev,
+                                 const SdmmcQueueEntry *next, u32 total)
+{
+    if ((prev->device != next->device) || (prev->write != next->write))
+        return false;
+
+    if (prev->sector + prev->count != next->sector)
+        return false;
+
+    if ((u8 *)prev->buffer + prev->count * 512 != (u8 *)next->buffer)
+        return false;
+
+    // SDMMC_readSectors() and SDMMC_writeSectors() take a 16-bit count
+    return total + next->count <= 0xFFFF;
+}
+
+void sdmmcQueueProcess(void)
+{
+    SdmmcQueueEntry entries[SDMMC_QUEUE_SLOTS];
+
+    if (sdmmcQueueRing == NULL)
+        return;
+
+    // New requests may be added by the ARM9 while others are being handled.
+    // Keep going until the ring is empty so that the bus isn't left idle.
+    while (1)
     {
-        return SDMMC_writeSectors(devNum, sect, buf, count);
+        size_t size = fifoRingRead(sdmmcQueueRing, entries, sizeof(entries));
+        u32 num = size / sizeof(SdmmcQueueEntry);
+        if (num == 0)
+            break;
+
+        u32 first = 0;
+        while (first < num)
+        {
+            // Merge requests for consecutive sectors and consecutive buffers
+            // into one multi-block command.
+            u32 total = entries[first].count;
+            u32 last = first;
+            while ((last + 1 < num) &&
+                   sdmmcQueueIsAdjacent(&entries[last], &entries[last + 1], total))
+            {
+                last++;
+                total += entries[last].count;
+            }
+
+            const SdmmcQueueEntry *e = &entries[first];
+            u32 result;
+
+            if (e->write)
+                result = sdmmcWriteSectors(e->device, e->sector, e->buffer, total);
+            else
+                result = sdmmcReadSectors(e->device, e->sector, e->buffer, total);
+
+            for (u32 i = first; i <= last; i++)
+            {
+                SdmmcQueueResult *r = &sdmmcQueue->results[entries[i].slot % SDMMC_QUEUE_SLOTS];
+                r->result = result;
+                r->done = 1;
+            }
+
+            first = last + 1;
+        }
+
+        // Wake up the threads of the ARM9 that are waiting for the results.
+        // The ARM9 ignores the address, it only needs an interrupt.
+        fifoSendAddress(FIFO_STORAGE, sdmmcQueue);
     }
 }
 
@@ -80,6 +270,9 @@ int sdmmcMsgHandler(int bytes, void *user_data, FifoMessage *msg)
             retval = sdmmcWriteSectors(SDMMC_DEV_eMMC, msg->sdParams.startsector,
                                        msg->sdParams.buffer, msg->sdParams.numsectors);
             break;
+        case SDMMC_QUEUE_SETUP:
+            sdmmcQueueSetup(msg->sdQueueParams.queue);
+            break;
     }
 
     return retval;
@@ -185,6 +185,13 @@ void systemMsgHandler(int bytes, void *user_data)
         case SYS_SET_ARM7_CONSOLE:
             consoleSetup(msg.setArm7Console.buffer);
             break;
+        case SYS_SET_INPUT_SHARED:
+            inputSetSharedBlock(msg.setInputShared.block);
+            break;
+        case SYS_SET_TOUCH_SAMPLING:
+            inputSetTouchSampling(msg.setTouchSampling.ring,
+                                  msg.setTouchSampling.rate);
+            break;
     }
 }
 
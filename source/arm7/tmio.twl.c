@@ -122,6 +122,7 @@ void TMIO_initPort(TmioPort *const port, const u8 portNum)
 {
     // Reset port state.
     port->portNum     = portNum;
+    port->noAutoStop  = 0;
     port->sd_clk_ctrl = SD_CLK_DEFAULT;
     port->sd_blocklen = 512;
     port->sd_option   = SD_OPTION_BUS_WIDTH1 | SD_OPTION_UNK14 | SD_OPTION_DEFAULT_TIMINGS;
@@ -223,8 +224,9 @@ static void doCpuTransfer(Tmio *const regs, const u16 cmd, u8 *buf,
     }
     else
     {
-        // TODO: Write first block ahead of time?
         // gbatek Command/Param/Response/Data at bottom of page.
+        // This is called right after sending the command, so the first block
+        // is written to the FIFO while the card handles the command.
         while ((GET_STATUS(statusPtr) & SD_STATUS_MASK_ERR) == 0 && blockCount > 0)
         {
             if (!(regs->sd_fifo32_cnt & SD_FIFO32_NOT_EMPTY)) // TX request.
@@ -273,7 +275,7 @@ u32 TMIO_sendCommand(TmioPort *const port, const u16 cmd, const u32 arg)
     setPort(regs, port);
     const u16 blocks = port->blocks;
     regs->sd_blockcount = blocks;         // sd_blockcount32 doesn't need to be set.
-    regs->sd_stop       = SD_STOP_AUTO_STOP; // Auto STOP_TRANSMISSION (CMD12) on multi-block transfer.
+    regs->sd_stop       = (port->noAutoStop ? 0 : SD_STOP_AUTO_STOP); // Auto STOP_TRANSMISSION (CMD12) on multi-block transfer.
     regs->sd_arg        = arg;
 
     // We don't need FIFO IRQs when using DMA. buf = NULL means DMA.
@@ -288,6 +290,12 @@ u32 TMIO_sendCommand(TmioPort *const port, const u16 cmd, const u32 arg)
     // Response end comes immediately after the
     // command so we need to check before __wfi().
     // On error response end still fires.
+    // Writes don't need to wait for the response. Filling the FIFO right away
+    // lets the controller send the first block as soon as the card is ready.
+    const bool writeAhead = (cmd & (CMD_DATA_EN | CMD_DATA_R)) == CMD_DATA_EN && buf != NULL;
+    if (writeAhead)
+        doCpuTransfer(regs, cmd, buf, statusPtr);
+
     while ((GET_STATUS(statusPtr) & SD_STATUS_RESP_END) == 0)
         swiHalt();
 
@@ -296,7 +304,7 @@ u32 TMIO_sendCommand(TmioPort *const port, const u16 cmd, const u32 arg)
     if ((cmd & CMD_DATA_EN) != 0)
     {
         // If we have to transfer data do so now.
-        if (buf != NULL)
+        if (buf != NULL && !writeAhead)
             doCpuTransfer(regs, cmd, buf, statusPtr);
 
         // Wait for data end if needed.
@@ -2,6 +2,7 @@
 //
 // Copyright (c) 2024 Antonio Niño Díaz
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -82,6 +83,9 @@ static GRFError grfExtract(const void *src, void **dst, size_t *sz)
         case 0x30: // RLE
             decompress(src, *dst, RLEVram);
             return GRF_NO_ERROR;
+        case 0x40: // LZ4
+            decompress(src, *dst, LZ4Vram);
+            return GRF_NO_ERROR;
         default:
             return GRF_UNKNOWN_COMPRESSION;
     }
@@ -179,6 +183,147 @@ GRFError grfLoadMem(const void *src, GRFHeader *header,
                         palDst, palSize, NULL, NULL, NULL, NULL);
 }
 
+// Size of the buffer used to read compressed data from a file
+#define GRF_STREAM_BUFFER_SIZE 512
+
+// State of the decompression of a compressed chunk read from a file. Data is
+// read from the file in small blocks as the BIOS requests it, so it's never
+// needed to have the whole compressed chunk in RAM.
+typedef struct
+{
+    FILE *file;
+    uint32_t header;
+    size_t remaining; // Bytes of the chunk that haven't been read from the file
+    size_t pos;
+    size_t len;
+    bool error;
+    uint8_t buffer[GRF_STREAM_BUFFER_SIZE];
+    uint8_t huffman_temp[0x200]; // Temporary buffer required by HUFF
+} GRFStream;
+
+// The BIOS only passes the current source address to the callbacks that read
+// data, so they can't get the state of the stream from their arguments. fread()
+// may yield to other cothreads while the BIOS is decompressing data, and they
+// may be decompressing their own streams, so the pointer is thread-local.
+static __thread GRFStream *grf_stream;
+
+static void grfStreamRefill(GRFStream *stream)
+{
+    size_t size = stream->remaining;
+    if (size > GRF_STREAM_BUFFER_SIZE)
+        size = GRF_STREAM_BUFFER_SIZE;
+
+    stream->pos = 0;
+    stream->len = fread(stream->buffer, 1, size, stream->file);
+    stream->remaining -= stream->len;
+
+    if (stream->len != size || size == 0)
+        stream->error = true;
+}
+
+static int grfStreamGetSize(uint8_t *source, uint16_t *dest, uint32_t arg)
+{
+    (void)source;
+    (void)dest;
+    (void)arg;
+
+    return grf_stream->header;
+}
+
+static uint8_t grfStreamReadByte(uint8_t *source)
+{
+    (void)source;
+
+    GRFStream *stream = grf_stream;
+
+    if (stream->pos == stream->len)
+    {
+        grfStreamRefill(stream);
+        if (stream->error)
+            return 0;
+    }
+
+    return stream->buffer[stream->pos++];
+}
+
+static uint32_t grfStreamReadWord(uint32_t *source)
+{
+    uint32_t value = grfStreamReadByte((uint8_t *)source);
+    value |= grfStreamReadByte((uint8_t *)source) << 8;
+    value |= grfStreamReadByte((uint8_t *)source) << 16;
+    value |= grfStreamReadByte((uint8_t *)source) << 24;
+    return value;
+}
+
+static int grfStreamGetResult(uint8_t *source)
+{
+    (void)source;
+
+    return grf_stream->error ? -1 : 0;
+}
+
+static TDecompressionStream grfStreamCallbacks =
+{
+    grfStreamGetSize,
+    grfStreamGetResult,
+    grfStreamReadByte,
+    NULL,
+    grfStreamReadWord
+};
+
+// Decompresses a chunk while it is read from the file. The header has already
+// been read. The destination can be in VRAM.
+static GRFError grfExtractFileStream(FILE *file, size_t chunk_size,
+                                     uint32_t header, void *dst)
+{
+    GRFStream *stream = malloc(sizeof(GRFStream));
+    if (stream == NULL)
+        return GRF_NOT_ENOUGH_MEMORY;
+
+    stream->file = file;
+    stream->header = header;
+    stream->remaining = chunk_size - 4;
+    stream->pos = 0;
+    stream->len = 0;
+    stream->error = false;
+
+    grf_stream = stream;
+
+    // The BIOS rejects source addresses outside of RAM, so pass the address of
+    // the buffer even if it isn't used by the callbacks.
+    void *src = stream->buffer;
+
+    switch (header & 0xF0)
+    {
+        case 0x10: // LZ77
+            decompressStreamStruct(src, dst, LZ77Vram, NULL, &grfStreamCallbacks);
+            break;
+        case 0x20: // Huffman
+            decompressStreamStruct(src, dst, HUFF, stream->huffman_temp,
+                                   &grfStreamCallbacks);
+            break;
+        case 0x30: // RLE
+            decompressStreamStruct(src, dst, RLEVram, NULL, &grfStreamCallbacks);
+            break;
+    }
+
+    grf_stream = NULL;
+
+    GRFError err = stream->error ? GRF_FILE_NOT_READ : GRF_NO_ERROR;
+
+    // Skip the padding at the end of the chunk, if any, so that the file
+    // points to the next chunk.
+    if ((err == GRF_NO_ERROR) && (stream->remaining > 0))
+    {
+        if (fseek(file, stream->remaining, SEEK_CUR) != 0)
+            err = GRF_FILE_NOT_READ;
+    }
+
+    free(stream);
+
+    return err;
+}
+
 // Extracts a GRF item from a FILE pointer
 static GRFError grfExtractFile(FILE *file, size_t chunk_size,
                                void **dst, size_t *sz)
@@ -197,6 +342,18 @@ static GRFError grfExtractFile(FILE *file, size_t chunk_size,
 
     uint32_t size = header >> 8;
 
+    switch (header & 0xF0)
+    {
+        case 0x00: // No compression
+        case 0x10: // LZ77
+        case 0x20: // Huffman
+        case 0x30: // RLE
+        case 0x40: // LZ4
+            break;
+        default:
+            return GRF_UNKNOWN_COMPRESSION;
+    }
+
     // Allocate destination buffer
     if (sz != NULL)
         *sz = size;
@@ -218,6 +375,18 @@ static GRFError grfExtractFile(FILE *file, size_t chunk_size,
         return GRF_NO_ERROR;
     }
 
+    // The BIOS can only stream formats that it supports. The extended LZ77
+    // format (type 0x11) and LZ4 need the whole compressed chunk in RAM. The
+    // software Huffman decoder needs it too, but it is a lot faster than the
+    // BIOS routine, so it's worth it.
+    bool whole_chunk = ((header & 0xFF) == 0x11) || ((header & 0xF0) == 0x40);
+    if (((header & 0xF0) == 0x20) &&
+        (decompressGetBackend() == DECOMPRESS_BACKEND_SOFTWARE))
+        whole_chunk = true;
+
+    if (!whole_chunk)
+        return grfExtractFileStream(file, chunk_size, header, *dst);
+
     // Allocate temporary buffer to hold the compressed contents of the file
 
     uint32_t *tmp = malloc(chunk_size);
@@ -227,30 +396,22 @@ static GRFError grfExtractFile(FILE *file, size_t chunk_size,
     // We have already read the header. Read the rest of the chunk.
     *tmp = header;
     if (fread(tmp + 1, 1, chunk_size - 4, file) != (chunk_size - 4))
-        return GRF_FILE_NOT_READ;
-
-    GRFError err = GRF_NO_ERROR;
-
-    switch (header & 0xF0)
     {
-        case 0x10: // LZ77
-            decompress(tmp, *dst, LZ77Vram);
-            break;
-        case 0x20: // Huffman
-            decompress(tmp, *dst, HUFF);
-            break;
-        case 0x30: // RLE
-            decompress(tmp, *dst, RLEVram);
-            break;
-        default:
-            err = GRF_UNKNOWN_COMPRESSION;
-            break;
+        free(tmp);
+        return GRF_FILE_NOT_READ;
     }
 
+    if ((header & 0xF0) == 0x40)
+        decompress(tmp, *dst, LZ4Vram);
+    else if ((header & 0xF0) == 0x20)
+        decompress(tmp, *dst, HUFF);
+    else
+        decompress(tmp, *dst, LZ77Vram);
+
     // Free the temporary buffer
     free(tmp);
 
-    return err;
+    return GRF_NO_ERROR;
 }
 
 GRFError grfLoadFileEx(FILE *file, GRFHeader *header,
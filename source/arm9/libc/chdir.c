@@ -35,7 +35,7 @@ int chdir(const char *path)
     {
         // This path includes a drive name. Split it.
 
-        char drive[10]; // The longest name of a drive is "nitro:"
+        char drive[10]; // The longest name of a drive is NITROFS_MAX_NAME_LEN
 
         // Size of the drive name
         size_t size = divide - path + 2;
@@ -49,7 +49,7 @@ int chdir(const char *path)
         memcpy(drive, path, size);
         drive[size - 1] = '\0';
 
-        if (!strcmp("nitro:", drive))
+        if (nitrofs_set_current_drive(drive))
         {
             current_drive_is_nitrofs = true;
         }
@@ -4,6 +4,7 @@
 
 #include <errno.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
@@ -14,6 +15,7 @@
 #include "fat.h"
 #include "ff.h"
 #include "fatfs/cache.h"
+#include "fatfs_internal.h"
 #include "filesystem_internal.h"
 
 #define DEFAULT_SECTORS_PER_PAGE    8 // Each sector is 512 bytes
@@ -360,6 +362,35 @@ bool fatInitDefault(void)
     return fatInit(-1, true);
 }
 
+// Returns the size in words that the lookup cache of a file needs to hold the
+// whole cluster chain of the file, or 0 on error.
+static uint32_t fatfs_lookup_cache_size(FIL *f)
+{
+    // FatFs always sets the first word of the table to the required size, even
+    // if the table is too small to hold the link map.
+    DWORD query[1] = { 1 };
+
+    f->cltbl = query;
+    FRESULT ret = f_lseek(f, CREATE_LINKMAP);
+    f->cltbl = NULL;
+
+    if (ret != FR_NOT_ENOUGH_CORE && ret != FR_OK)
+        return 0;
+
+    return query[0];
+}
+
+void fatfs_free_lookup_cache(FIL *f)
+{
+    if (f->cltbl == NULL)
+        return;
+
+    if (!cache_stub_slack_free(f->cltbl))
+        free(f->cltbl);
+
+    f->cltbl = NULL;
+}
+
 int fatInitLookupCache(int fd, uint32_t max_buffer_size)
 {
     if (!FD_IS_FAT(fd))
@@ -369,6 +400,37 @@ int fatInitLookupCache(int fd, uint32_t max_buffer_size)
     if (f->cltbl != NULL)
         return FAT_INIT_LOOKUP_CACHE_ALREADY_ALLOCATED;
 
+    if (max_buffer_size == 0)
+    {
+        // Allocate a look-up cache that fits the whole file
+        // -------------------------------------------------
+
+        uint32_t size = fatfs_lookup_cache_size(f) * sizeof(DWORD);
+        if (size == 0)
+            return FAT_INIT_LOOKUP_CACHE_NOT_SUPPORTED;
+
+        // Try to use the unused DLDI stub space before using the heap. For
+        // defragmented files, the table only needs a few words.
+        DWORD *cltbl = cache_stub_slack_alloc(size);
+        if (cltbl == NULL)
+        {
+            cltbl = malloc(size);
+            if (cltbl == NULL)
+                return FAT_INIT_LOOKUP_CACHE_OUT_OF_MEMORY;
+        }
+
+        f->cltbl = cltbl;
+        f->cltbl[0] = size / sizeof(DWORD);
+
+        if (f_lseek(f, CREATE_LINKMAP) != FR_OK)
+        {
+            fatfs_free_lookup_cache(f);
+            return FAT_INIT_LOOKUP_CACHE_NOT_SUPPORTED;
+        }
+
+        return 0;
+    }
+
     // Allocate initial look-up cache area
     // -----------------------------------
 
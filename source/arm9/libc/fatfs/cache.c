@@ -26,6 +26,7 @@ static uint8_t *cache_mem;
 static uint32_t cache_num_sectors = 0;
 static uint32_t dldi_stub_space_sectors;
 static uint32_t usage_counter = 0;
+static bool stub_slack_used = false;
 
 extern uint8_t *dldiGetStubDataEnd(void);
 extern uint8_t *dldiGetStubEnd(void);
@@ -190,3 +191,49 @@ void cache_sector_invalidate(uint8_t pdrv, uint32_t sector_from, uint32_t sector
         entry->valid = 0;
     }
 }
+
+uint32_t cache_sector_count(void)
+{
+    return cache_num_sectors;
+}
+
+// The sector cache only uses whole sectors of the unused DLDI stub space,
+// starting from the end. The space between the end of the driver and the first
+// sector is never used by the cache, so it can be lent to a single user.
+static uint8_t *cache_stub_slack_start(void)
+{
+    uintptr_t start = (uintptr_t)dldiGetStubDataEnd();
+    return (uint8_t *)((start + 3) & ~3);
+}
+
+static uint8_t *cache_stub_slack_end(void)
+{
+    int32_t stub_space_sectors = (dldiGetStubEnd() - dldiGetStubDataEnd()) >> 9;
+    if (stub_space_sectors < 0)
+        return NULL;
+
+    return dldiGetStubEnd() - stub_space_sectors * FF_MAX_SS;
+}
+
+void *cache_stub_slack_alloc(size_t size)
+{
+    if (stub_slack_used)
+        return NULL;
+
+    uint8_t *start = cache_stub_slack_start();
+    uint8_t *end = cache_stub_slack_end();
+    if (end == NULL || start >= end || (size_t)(end - start) < size)
+        return NULL;
+
+    stub_slack_used = true;
+    return start;
+}
+
+bool cache_stub_slack_free(void *ptr)
+{
+    if (!stub_slack_used || ptr != cache_stub_slack_start())
+        return false;
+
+    stub_slack_used = false;
+    return true;
+}
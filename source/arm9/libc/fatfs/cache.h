@@ -15,6 +15,19 @@ int cache_init(int32_t num_sectors);
 void *cache_sector_get(uint8_t pdrv, uint32_t sector);
 void *cache_sector_add(uint8_t pdrv, uint32_t sector);
 void cache_sector_invalidate(uint8_t pdrv, uint32_t sector_from, uint32_t sector_to);
+uint32_t cache_sector_count(void);
+
+/**
+ * Allocate a buffer from the DLDI stub space that isn't used by the cache.
+ * Only one buffer can be allocated at a time. Returns NULL if it doesn't fit.
+ */
+void *cache_stub_slack_alloc(size_t size);
+
+/**
+ * Free a buffer allocated with cache_stub_slack_alloc(). Returns false if the
+ * buffer wasn't allocated by it.
+ */
+bool cache_stub_slack_free(void *ptr);
 
 /**
  * "Borrow" an unused cache entry to use as a write buffer.
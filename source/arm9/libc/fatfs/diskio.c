@@ -41,6 +41,7 @@
 #include <nds/memory.h>
 #include <nds/system.h>
 
+#include "arm9/libnds_internal.h"
 #include "../fatfs_internal.h"
 
 #include "ff.h"     // Obtains integer types
@@ -139,6 +140,91 @@ DSTATUS disk_initialize(BYTE pdrv)
 
 #define IS_WORD_ALIGNED(buff) (!(((uintptr_t) (buff)) & 0x03))
 
+#define TRACE_DEVICE(pdrv) ((pdrv) == DEV_SD ? STORAGE_TRACE_DEV_SD : STORAGE_TRACE_DEV_DLDI)
+
+// Reads sectors through the cache of DLDI devices. All the sectors of a window
+// that aren't in the cache are read with a single list of extents, so that a
+// fragmented set of cache misses only needs one message to the ARM7 instead of
+// one message per sector.
+//
+// The window is never bigger than the cache, so adding sectors to the cache
+// can't evict other sectors of the same window before they are copied.
+static DRESULT disk_read_dldi_cached(BYTE *buff, LBA_t sector, UINT count)
+{
+    const BYTE pdrv = DEV_DLDI;
+
+    uint32_t window = cache_sector_count();
+    if (window > DLDI_LIST_MAX_EXTENTS)
+        window = DLDI_LIST_MAX_EXTENTS;
+
+    void *cache[DLDI_LIST_MAX_EXTENTS];
+    DISC_EXTENT extents[DLDI_LIST_MAX_EXTENTS];
+
+    while (count > 0)
+    {
+        UINT n = count < window ? count : window;
+        size_t num_extents = 0;
+        UINT misses = 0;
+
+        for (UINT i = 0; i < n; i++)
+        {
+            cache[i] = cache_sector_get(pdrv, sector + i);
+            if (cache[i] != NULL)
+                continue;
+
+            cache[i] = cache_sector_add(pdrv, sector + i);
+            misses++;
+
+            // Merge the sector with the previous extent if possible
+            if (num_extents > 0)
+            {
+                DISC_EXTENT *last = &extents[num_extents - 1];
+                if (((last->sector + last->numSectors) == (sector + i))
+                    && (((u8 *)last->buffer + last->numSectors * FF_MAX_SS)
+                        == (u8 *)cache[i]))
+                {
+                    last->numSectors++;
+                    continue;
+                }
+            }
+
+            extents[num_extents].sector = sector + i;
+            extents[num_extents].numSectors = 1;
+            extents[num_extents].buffer = cache[i];
+            num_extents++;
+        }
+
+        if (num_extents > 0)
+        {
+            storage_trace_start_t start = storage_trace_begin();
+            bool ok = dldiReadSectorsList(extents, num_extents);
+            storage_trace_end(start, STORAGE_TRACE_DEV_DLDI,
+                              STORAGE_TRACE_PATH_CACHE, false, sector, misses,
+                              !ok);
+            if (!ok)
+            {
+                for (size_t i = 0; i < num_extents; i++)
+                {
+                    cache_sector_invalidate(pdrv, extents[i].sector,
+                        extents[i].sector + extents[i].numSectors - 1);
+                }
+                return RES_ERROR;
+            }
+        }
+
+        for (UINT i = 0; i < n; i++)
+        {
+            __aeabi_memcpy(buff, cache[i], FF_MAX_SS);
+            buff += FF_MAX_SS;
+        }
+
+        count -= n;
+        sector += n;
+    }
+
+    return RES_OK;
+}
+
 //-----------------------------------------------------------------------
 // Read Sector(s)
 //-----------------------------------------------------------------------
@@ -176,7 +262,11 @@ DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count)
             if (!cacheable && memBufferIsInMainRam(buff, count << 9)
                 && (pdrv == DEV_SD || IS_WORD_ALIGNED(buff)))
             {
-                if (!io->readSectors(sector, count, buff))
+                storage_trace_start_t start = storage_trace_begin();
+                bool ok = io->readSectors(sector, count, buff);
+                storage_trace_end(start, TRACE_DEVICE(pdrv), STORAGE_TRACE_PATH_DIRECT,
+                                  false, sector, count, !ok);
+                if (!ok)
                     return RES_ERROR;
 
                 return RES_OK;
@@ -189,7 +279,11 @@ DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count)
 
                 while (count > 0)
                 {
-                    if (!io->readSectors(sector, 1, cache))
+                    storage_trace_start_t start = storage_trace_begin();
+                    bool ok = io->readSectors(sector, 1, cache);
+                    storage_trace_end(start, TRACE_DEVICE(pdrv), STORAGE_TRACE_PATH_BOUNCE,
+                                      false, sector, 1, !ok);
+                    if (!ok)
                     {
                         return RES_ERROR;
                     }
@@ -201,6 +295,10 @@ DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count)
                     buff += FF_MAX_SS;
                 }
             }
+            else if ((pdrv == DEV_DLDI) && (cache_sector_count() > 0))
+            {
+                return disk_read_dldi_cached(buff, sector, count);
+            }
             else
             {
                 while (count > 0)
@@ -211,7 +309,11 @@ DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count)
                     {
                         cache = cache_sector_add(pdrv, sector);
 
-                        if (!io->readSectors(sector, 1, cache))
+                        storage_trace_start_t start = storage_trace_begin();
+                        bool ok = io->readSectors(sector, 1, cache);
+                        storage_trace_end(start, TRACE_DEVICE(pdrv), STORAGE_TRACE_PATH_CACHE,
+                                          false, sector, 1, !ok);
+                        if (!ok)
                         {
                             cache_sector_invalidate(pdrv, sector, sector);
                             return RES_ERROR;
@@ -271,7 +373,11 @@ DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count)
                 while (count > 0)
                 {
                     __aeabi_memcpy(align_buffer, buff, FF_MAX_SS);
-                    if (!io->writeSectors(sector, 1, align_buffer))
+                    storage_trace_start_t start = storage_trace_begin();
+                    bool ok = io->writeSectors(sector, 1, align_buffer);
+                    storage_trace_end(start, TRACE_DEVICE(pdrv), STORAGE_TRACE_PATH_BOUNCE,
+                                      true, sector, 1, !ok);
+                    if (!ok)
                     {
                         free(align_buffer);
                         return RES_ERROR;
@@ -285,7 +391,11 @@ DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count)
 #ifndef DISABLE_DIRECT_WRITES
             else
             {
-                if (!io->writeSectors(sector, count, buff))
+                storage_trace_start_t start = storage_trace_begin();
+                bool ok = io->writeSectors(sector, count, buff);
+                storage_trace_end(start, TRACE_DEVICE(pdrv), STORAGE_TRACE_PATH_DIRECT,
+                                  true, sector, count, !ok);
+                if (!ok)
                     return RES_ERROR;
             }
 #endif
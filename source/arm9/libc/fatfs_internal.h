@@ -14,5 +14,6 @@
 
 int fatfs_error_to_posix(FRESULT error);
 uint32_t fatfs_timestamp_to_fattime(struct tm *stm);
+void fatfs_free_lookup_cache(FIL *f);
 
 #endif // FATFS_INTERNAL_H__
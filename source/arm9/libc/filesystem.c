@@ -196,8 +196,7 @@ int close(int fd)
 
     FRESULT result = f_close(fp);
 
-    if (fp->cltbl != NULL)
-        free(fp->cltbl);
+    fatfs_free_lookup_cache(fp);
     free(fp);
 
     if (result == FR_OK)
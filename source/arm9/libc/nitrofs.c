@@ -32,13 +32,21 @@
 #include "ff.h"
 #include "fatfs_internal.h"
 #undef DIR
+#include "arm9/libnds_internal.h"
 #include "filesystem_internal.h"
 #include "nitrofs_internal.h"
 
 // Include "dirent.h" after the FatFs inclusion hack.
 #include <dirent.h>
 
-static nitrofs_t nitrofs_local;
+// Slot 0 is always reserved for "nitro:", which is set up by nitroFSInit().
+static nitrofs_t nitrofs_mounts[NITROFS_MAX_MOUNTS] = {
+    { .name = "nitro:" },
+};
+#define nitrofs_local (nitrofs_mounts[0])
+
+// NitroFS drive used for paths without a drive name
+static nitrofs_t *nitrofs_current = &nitrofs_mounts[0];
 
 /// Configuration
 #define ENABLE_DOTDOT_EMULATION
@@ -46,28 +54,114 @@ static nitrofs_t nitrofs_local;
 
 /// Helper functions
 
+// Returns the mount with the given drive name ("dlc:"), or NULL if there isn't
+// any. The length includes the colon.
+static nitrofs_t *nitrofs_find_mount(const char *name, size_t len)
+{
+    if (len == 0 || len > NITROFS_MAX_NAME_LEN)
+        return NULL;
+
+    for (int i = 0; i < NITROFS_MAX_MOUNTS; i++)
+    {
+        nitrofs_t *fs = &nitrofs_mounts[i];
+        if (!memcmp(fs->name, name, len) && fs->name[len] == '\0')
+            return fs;
+    }
+
+    return NULL;
+}
+
+// Returns the mount a path refers to. If the path has a drive name, it is
+// skipped, so that the path left in "path" is absolute. Returns NULL if the
+// drive name doesn't belong to NitroFS.
+static nitrofs_t *nitrofs_mount_for_path(const char **path)
+{
+    const char *divide = strstr(*path, ":/");
+    if (divide == NULL)
+        return current_drive_is_nitrofs ? nitrofs_current : NULL;
+
+    nitrofs_t *fs = nitrofs_find_mount(*path, divide - *path + 1);
+    if (fs != NULL)
+        *path = divide + 1;
+
+    return fs;
+}
+
+static bool nitrofs_is_mounted(const nitrofs_t *fs)
+{
+    if (fs->layer_count > 0)
+        return true;
+
+    return fs->fnt_offset != 0;
+}
+
 bool nitrofs_use_for_path(const char *path)
 {
-    if (strstr(path, ":/"))
-        return !memcmp(path, "nitro:/", 7);
+    const char *divide = strstr(path, ":/");
+    if (divide)
+        return nitrofs_find_mount(path, divide - path + 1) != NULL;
     else
         return current_drive_is_nitrofs;
 }
 
+bool nitrofs_set_current_drive(const char *drive)
+{
+    nitrofs_t *fs = nitrofs_find_mount(drive, strlen(drive));
+    if (fs == NULL)
+        return false;
+
+    nitrofs_current = fs;
+    return true;
+}
+
 // Symbol defined by the linker
 extern char __dtcm_start[];
 const uintptr_t DTCM_START = (uintptr_t)__dtcm_start;
 const uintptr_t DTCM_END   = DTCM_START + (16 * 1024) - 1;
 
-static ssize_t nitrofs_read_internal(void *ptr, size_t offset, size_t len)
+// Serves a read from an in-memory copy of a table of the image. Reads that go
+// past the end of the table are padded with zeroes, which is enough for the
+// directory parser, as every FNT sub-table is terminated by a zero byte.
+static bool nitrofs_read_table_cache(const uint8_t *cache, uint32_t table_offset,
+                                     uint32_t table_size, void *ptr,
+                                     size_t offset, size_t len)
 {
-    if (nitrofs_local.file)
+    if (cache == NULL || offset < table_offset || offset >= table_offset + table_size)
+        return false;
+
+    size_t start = offset - table_offset;
+    size_t available = table_size - start;
+
+    if (len <= available)
+    {
+        memcpy(ptr, cache + start, len);
+    }
+    else
+    {
+        memcpy(ptr, cache + start, available);
+        memset((uint8_t *)ptr + available, 0, len - available);
+    }
+
+    return true;
+}
+
+static ssize_t nitrofs_read_internal(nitrofs_t *fs, void *ptr, size_t offset, size_t len)
+{
+    if (nitrofs_read_table_cache(fs->fnt_cache, fs->fnt_offset, fs->fnt_size,
+                                 ptr, offset, len))
+        return len;
+
+    if (nitrofs_read_table_cache(fs->fat_cache, fs->fat_offset, fs->fat_size,
+                                 ptr, offset, len))
+        return len;
+
+    if (fs->file)
     {
-        fseek(nitrofs_local.file, offset, SEEK_SET);
-        return fread(ptr, 1, len, nitrofs_local.file);
+        fseek(fs->file, offset, SEEK_SET);
+        return fread(ptr, 1, len, fs->file);
     }
 
-    if (nitrofs_local.use_slot2)
+    if (fs->use_slot2)
     {
         sysSetCartOwner(BUS_OWNER_ARM9);
         memcpy(ptr, (void *)(0x08000000 + offset), len);
@@ -92,7 +186,10 @@ static ssize_t nitrofs_read_internal(void *ptr, size_t offset, size_t len)
                 {
                     size_t read_size = len > FF_MAX_SS ? FF_MAX_SS : len;
 
+                    storage_trace_start_t start = storage_trace_begin();
                     cardReadArm7(cache, offset, read_size, __NDSHeader->cardControl13);
+                    storage_trace_end(start, STORAGE_TRACE_DEV_CARD, STORAGE_TRACE_PATH_BOUNCE,
+                                      false, offset, read_size, false);
 
                     __aeabi_memcpy(buff, cache, read_size);
 
@@ -105,14 +202,20 @@ static ssize_t nitrofs_read_internal(void *ptr, size_t offset, size_t len)
             }
             else
             {
+                storage_trace_start_t start = storage_trace_begin();
                 cardReadArm7(ptr, offset, len, __NDSHeader->cardControl13);
+                storage_trace_end(start, STORAGE_TRACE_DEV_CARD, STORAGE_TRACE_PATH_ARM7,
+                                  false, offset, len, false);
                 return len;
             }
         }
         else
         {
             sysSetCardOwner(BUS_OWNER_ARM9);
+            storage_trace_start_t start = storage_trace_begin();
             cardRead(ptr, offset, len, __NDSHeader->cardControl13);
+            storage_trace_end(start, STORAGE_TRACE_DEV_CARD, STORAGE_TRACE_PATH_DIRECT,
+                              false, offset, len, false);
             return len;
         }
     }
@@ -120,12 +223,14 @@ static ssize_t nitrofs_read_internal(void *ptr, size_t offset, size_t len)
 
 /// Directory I/O
 
-static bool nitrofs_dir_state_init(nitrofs_dir_state_t *state, uint16_t dir)
+static bool nitrofs_dir_state_init(nitrofs_t *fs, nitrofs_dir_state_t *state,
+                                   uint16_t dir)
 {
     nitrofs_fnt_entry_t fnt_entry;
 
-    nitrofs_read_internal(&fnt_entry, nitrofs_local.fnt_offset + ((dir - 0xF000) * 8), sizeof(fnt_entry));
-    state->offset = nitrofs_local.fnt_offset + fnt_entry.offset;
+    nitrofs_read_internal(fs, &fnt_entry, fs->fnt_offset + ((dir - 0xF000) * 8), sizeof(fnt_entry));
+    state->fs = fs;
+    state->offset = fs->fnt_offset + fnt_entry.offset;
     state->sector_offset = 0;
     state->position = 0;
     state->file_index = fnt_entry.first_file;
@@ -136,7 +241,7 @@ static bool nitrofs_dir_state_init(nitrofs_dir_state_t *state, uint16_t dir)
     state->dotdot_offset = dir == 0xF000 ? 0 : -2;
 #endif
 
-    if (nitrofs_local.file == NULL)
+    if (fs->file == NULL)
     {
         // Card reads benefit from word-aligning table accesses.
         state->position = state->offset & 3;
@@ -144,7 +249,7 @@ static bool nitrofs_dir_state_init(nitrofs_dir_state_t *state, uint16_t dir)
     }
 
     state->buffer[state->position] = 0;
-    nitrofs_read_internal(state->buffer, state->offset, 512);
+    nitrofs_read_internal(fs, state->buffer, state->offset, 512);
     return state->buffer[state->position] != 0;
 }
 
@@ -174,7 +279,8 @@ static bool nitrofs_dir_state_next(nitrofs_dir_state_t *state)
             memcpy(state->buffer, state->buffer + shift, next_sector_offset);
             state->offset += 512;
             state->sector_offset = next_sector_offset;
-            nitrofs_read_internal(state->buffer + next_sector_offset, state->offset, 512);
+            nitrofs_read_internal(state->fs, state->buffer + next_sector_offset,
+                                  state->offset, 512);
             state->position &= 3;
         }
     }
@@ -198,17 +304,167 @@ static uint16_t nitrofs_dir_state_index(nitrofs_dir_state_t *state)
     }
 }
 
-static uint16_t nitrofs_dir_parent_index(uint16_t dir)
+static uint16_t nitrofs_dir_parent_index(nitrofs_t *fs, uint16_t dir)
 {
     if (dir <= 0xF000)
         return dir;
 
     nitrofs_fnt_entry_t fnt_entry;
-    nitrofs_read_internal(&fnt_entry, nitrofs_local.fnt_offset + ((dir - 0xF000) * 8), sizeof(fnt_entry));
+    nitrofs_read_internal(fs, &fnt_entry, fs->fnt_offset + ((dir - 0xF000) * 8), sizeof(fnt_entry));
     return fnt_entry.parent;
 }
 
-static int32_t nitrofs_dir_step(uint16_t dir, const char *name)
+/// Path index
+
+static uint32_t nitrofs_index_hash(uint16_t parent, const char *name, size_t len)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u ^ parent;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Returns the ID of an entry of a directory, or -1 if it isn't found.
+static int32_t nitrofs_index_find(nitrofs_t *fs, uint16_t dir, const char *name,
+                                  size_t len)
+{
+    uint32_t i = nitrofs_index_hash(dir, name, len) & fs->index_mask;
+
+    while (1)
+    {
+        nitrofs_index_entry_t *entry = &fs->index[i];
+        if (entry->name == 0)
+            return -1;
+
+        const uint8_t *entry_name = fs->fnt_cache + entry->name;
+        if (entry->parent == dir && (entry_name[0] & 0x7F) == len
+            && !memcmp(name, entry_name + 1, len))
+            return entry->id;
+
+        i = (i + 1) & fs->index_mask;
+    }
+}
+
+// Walks all the directories of the FNT cache. If "index" isn't NULL, all the
+// entries are added to it. It returns the number of entries, or -1 if the FNT
+// is malformed.
+static int32_t nitrofs_index_fill(nitrofs_t *fs, nitrofs_index_entry_t *index,
+                                  uint32_t mask)
+{
+    const uint8_t *fnt = fs->fnt_cache;
+    uint32_t size = fs->fnt_size;
+
+    if (size < sizeof(nitrofs_fnt_entry_t))
+        return -1;
+
+    // The parent of the root directory is the number of directories
+    nitrofs_fnt_entry_t root;
+    memcpy(&root, fnt, sizeof(root));
+    uint32_t num_dirs = root.parent;
+    if (num_dirs == 0 || num_dirs > 0x1000 || num_dirs * sizeof(root) > size)
+        return -1;
+
+    int32_t count = 0;
+
+    for (uint32_t d = 0; d < num_dirs; d++)
+    {
+        nitrofs_fnt_entry_t dir;
+        memcpy(&dir, fnt + d * sizeof(dir), sizeof(dir));
+
+        uint32_t pos = dir.offset;
+        uint16_t file_index = dir.first_file;
+
+        while (1)
+        {
+            if (pos >= size)
+                return -1;
+
+            uint8_t type = fnt[pos];
+            if (type == 0)
+                break;
+
+            uint32_t len = type & 0x7F;
+            uint32_t next = pos + 1 + len + ((type & 0x80) ? 2 : 0);
+            if (next > size)
+                return -1;
+
+            if (index != NULL)
+            {
+                uint16_t id;
+                if (type & 0x80)
+                    id = fnt[pos + 1 + len] | (fnt[pos + 2 + len] << 8);
+                else
+                    id = file_index;
+
+                uint16_t parent = 0xF000 + d;
+                uint32_t i = nitrofs_index_hash(parent, (const char *)fnt + pos + 1, len) & mask;
+
+                // Keep the first entry if a name is repeated, like a scan would
+                bool found = false;
+                while (index[i].name != 0)
+                {
+                    const uint8_t *name = fnt + index[i].name;
+                    if (index[i].parent == parent && (name[0] & 0x7F) == len
+                        && !memcmp(name + 1, fnt + pos + 1, len))
+                    {
+                        found = true;
+                        break;
+                    }
+                    i = (i + 1) & mask;
+                }
+
+                if (!found)
+                {
+                    index[i].name = pos;
+                    index[i].parent = parent;
+                    index[i].id = id;
+                }
+            }
+
+            if (!(type & 0x80))
+                file_index++;
+
+            count++;
+            pos = next;
+        }
+    }
+
+    return count;
+}
+
+// Builds the path index of an image from its FNT cache, so that every path
+// component is resolved with a hash table lookup instead of a directory scan.
+// If there isn't enough RAM, or the FNT isn't cached, the image keeps scanning
+// directories.
+static void nitrofs_image_build_index(nitrofs_t *fs)
+{
+    if (fs->fnt_cache == NULL || fs->index != NULL)
+        return;
+
+    int32_t count = nitrofs_index_fill(fs, NULL, 0);
+    if (count <= 0)
+        return;
+
+    // Keep the load factor at 50% or lower
+    uint32_t slots = 16;
+    while (slots < (uint32_t)count * 2)
+        slots <<= 1;
+
+    nitrofs_index_entry_t *index = calloc(slots, sizeof(nitrofs_index_entry_t));
+    if (index == NULL)
+        return;
+
+    nitrofs_index_fill(fs, index, slots - 1);
+
+    fs->index = index;
+    fs->index_mask = slots - 1;
+}
+
+static int32_t nitrofs_dir_step(nitrofs_t *fs, uint16_t dir, const char *name)
 {
     nitrofs_dir_state_t state;
 
@@ -216,12 +472,16 @@ static int32_t nitrofs_dir_step(uint16_t dir, const char *name)
         return dir;
 
     if (!strcmp(name, ".."))
-        return nitrofs_dir_parent_index(dir);
+        return nitrofs_dir_parent_index(fs, dir);
 
-    if (!nitrofs_dir_state_init(&state, dir))
+    size_t name_len = strlen(name);
+
+    if (fs->index != NULL)
+        return nitrofs_index_find(fs, dir, name, name_len);
+
+    if (!nitrofs_dir_state_init(fs, &state, dir))
         return dir;
 
-    size_t name_len = strlen(name);
     do
     {
         uint8_t type = state.buffer[state.position];
@@ -233,27 +493,105 @@ static int32_t nitrofs_dir_step(uint16_t dir, const char *name)
     return -1;
 }
 
-int nitrofs_opendir(nitrofs_dir_state_t *state, const char *name)
+// Resolves a path without drive name inside an image, starting from the
+// directory "dir" if the path is relative.
+static int32_t nitrofs_image_resolve(nitrofs_t *fs, uint16_t dir, const char *path)
+{
+    int32_t entry;
+    if (path[0] == '/')
+    {
+        // start from root directory
+        entry = 0xF000;
+        path++;
+    }
+    else
+    {
+        // start from current directory
+        entry = dir;
+    }
+
+    char *sep = (char *) path;
+    while (sep)
+    {
+        sep = strchr(path, '/');
+        if (sep)
+            *sep = 0;
+        entry = nitrofs_dir_step(fs, entry, path);
+        if (sep)
+        {
+            *sep = '/';
+            path = sep + 1;
+        }
+        if (entry < 0)
+            return entry;
+    }
+    return entry;
+}
+
+// Resolves a path in a mounted drive. On success, it returns the ID of the
+// entry and the image that contains it. Paths in overlays are resolved against
+// each one of the images of the overlay, in order, and the first match is used.
+static int32_t nitrofs_resolve(const char *path, nitrofs_t **out)
 {
-    if (!nitrofs_local.fnt_offset)
+    nitrofs_t *mount = nitrofs_mount_for_path(&path);
+    if (mount == NULL || !nitrofs_is_mounted(mount))
     {
         errno = ENODEV;
         return -1;
     }
 
-    int32_t res = nitrofs_path_resolve(name);
-    if (res < 0)
+    if (mount->layer_count == 0)
     {
-        errno = ENOENT;
-        return -1;
+        *out = mount;
+        int32_t res = nitrofs_image_resolve(mount, mount->current_dir, path);
+        if (res < 0)
+            errno = ENOENT;
+        return res;
     }
-    nitrofs_dir_state_init(state, res);
+
+    for (int i = 0; i < mount->layer_count; i++)
+    {
+        nitrofs_t *layer = mount->layers[i];
+        uint16_t dir = mount->layer_dirs[i];
+
+        // Relative paths can only be found in images that have the current
+        // directory of the overlay.
+        if (path[0] != '/' && dir == 0)
+            continue;
+
+        int32_t res = nitrofs_image_resolve(layer, dir, path);
+        if (res >= 0)
+        {
+            *out = layer;
+            return res;
+        }
+    }
+
+    errno = ENOENT;
+    return -1;
+}
+
+int32_t nitrofs_path_resolve(const char *path)
+{
+    nitrofs_t *fs;
+    return nitrofs_resolve(path, &fs);
+}
+
+int nitrofs_opendir(nitrofs_dir_state_t *state, const char *name)
+{
+    nitrofs_t *fs;
+
+    int32_t res = nitrofs_resolve(name, &fs);
+    if (res < 0)
+        return -1; // errno has already been set
+
+    nitrofs_dir_state_init(fs, state, res);
     return 0;
 }
 
 int nitrofs_rewinddir(nitrofs_dir_state_t *state)
 {
-    nitrofs_dir_state_init(state, state->dir_opened);
+    nitrofs_dir_state_init(state->fs, state, state->dir_opened);
     return 0;
 }
 
@@ -301,46 +639,9 @@ int nitrofs_readdir(nitrofs_dir_state_t *state, struct dirent *ent)
     return 0;
 }
 
-int32_t nitrofs_path_resolve(const char *path)
-{
-    int32_t entry;
-    if (path[0] == '/')
-    {
-        // start from root directory
-        entry = 0xF000;
-        path++;
-    }
-    else if (!memcmp(path, "nitro:/", 7))
-    {
-        // start from root directory
-        entry = 0xF000;
-        path += 7;
-    }
-    else
-    {
-        // start from current directory
-        entry = nitrofs_local.current_dir;
-    }
-
-    char *sep = (char *) path;
-    while (sep)
-    {
-        sep = strchr(path, '/');
-        if (sep)
-            *sep = 0;
-        entry = nitrofs_dir_step(entry, path);
-        if (sep)
-        {
-            *sep = '/';
-            path = sep + 1;
-        }
-        if (entry < 0)
-            return entry;
-    }
-    return entry;
-}
-
-int nitrofs_getcwd(char *buf, size_t size)
+// Builds the path of directory "dir" of an image, prefixed by a drive name.
+static int nitrofs_image_getcwd(nitrofs_t *fs, uint16_t dir, const char *drive,
+                                char *buf, size_t size)
 {
     nitrofs_dir_state_t state;
     uint16_t subdirs[MAX_NESTED_SUBDIRS];
@@ -348,13 +649,13 @@ int nitrofs_getcwd(char *buf, size_t size)
     size_t bufpos = 0;
 
     // make a list of directories to traverse
-    int32_t res = nitrofs_local.current_dir;
+    int32_t res = dir;
     while (res > 0xF000)
     {
         if (subdir_count >= MAX_NESTED_SUBDIRS)
             return -1;
         subdirs[subdir_count++] = res;
-        res = nitrofs_dir_parent_index(res);
+        res = nitrofs_dir_parent_index(fs, res);
     }
     if (res < 0xF000)
     {
@@ -362,14 +663,15 @@ int nitrofs_getcwd(char *buf, size_t size)
         return -1;
     }
 
-    // append "nitro:"
-    if (bufpos >= (size - 6))
+    // append drive name, like "nitro:"
+    size_t drive_len = strlen(drive);
+    if (bufpos >= (size - drive_len))
     {
         errno = ERANGE;
         return -1;
     }
-    memcpy(buf, "nitro:", 6);
-    bufpos += 6;
+    memcpy(buf, drive, drive_len);
+    bufpos += drive_len;
 
     // If we are in the root directory add a slash to form "nitro:/"
     if (subdir_count == 0)
@@ -398,7 +700,7 @@ int nitrofs_getcwd(char *buf, size_t size)
         buf[bufpos++] = '/';
 
         // open parent directory
-        if (!nitrofs_dir_state_init(&state, curr_dir))
+        if (!nitrofs_dir_state_init(fs, &state, curr_dir))
         {
             errno = EINVAL;
             return -1;
@@ -443,15 +745,72 @@ int nitrofs_getcwd(char *buf, size_t size)
     return 0;
 }
 
+int nitrofs_getcwd(char *buf, size_t size)
+{
+    nitrofs_t *mount = nitrofs_current;
+
+    if (mount->layer_count == 0)
+        return nitrofs_image_getcwd(mount, mount->current_dir, mount->name, buf, size);
+
+    // In overlays, use the first image that contains the current directory.
+    // The path is the same in all of them.
+    for (int i = 0; i < mount->layer_count; i++)
+    {
+        if (mount->layer_dirs[i] != 0)
+        {
+            return nitrofs_image_getcwd(mount->layers[i], mount->layer_dirs[i],
+                                        mount->name, buf, size);
+        }
+    }
+
+    errno = EINVAL;
+    return -1;
+}
+
 int nitrofs_chdir(const char *path)
 {
-    if (!nitrofs_local.fnt_offset)
+    nitrofs_t *mount = nitrofs_mount_for_path(&path);
+    if (mount == NULL || !nitrofs_is_mounted(mount))
         return FR_NO_FILESYSTEM;
 
-    int32_t res = nitrofs_path_resolve(path);
-    if (res < 0)
+    if (mount->layer_count == 0)
+    {
+        int32_t res = nitrofs_image_resolve(mount, mount->current_dir, path);
+        if (res < 0)
+            return FR_NO_PATH;
+        mount->current_dir = res;
+        return FR_OK;
+    }
+
+    // Move to the new directory in all the images of the overlay. The images
+    // that don't have it are skipped by relative paths until the current
+    // directory changes again.
+    uint16_t layer_dirs[NITROFS_MAX_MOUNTS];
+    bool found = false;
+
+    for (int i = 0; i < mount->layer_count; i++)
+    {
+        uint16_t dir = mount->layer_dirs[i];
+        int32_t res = -1;
+
+        if (path[0] == '/' || dir != 0)
+            res = nitrofs_image_resolve(mount->layers[i], dir, path);
+
+        if (res >= 0xF000)
+        {
+            layer_dirs[i] = res;
+            found = true;
+        }
+        else
+        {
+            layer_dirs[i] = 0;
+        }
+    }
+
+    if (!found)
         return FR_NO_PATH;
-    nitrofs_local.current_dir = res;
+
+    memcpy(mount->layer_dirs, layer_dirs, sizeof(layer_dirs));
     return FR_OK;
 }
 
@@ -465,7 +824,7 @@ ssize_t nitrofs_read(int fd, void *ptr, size_t len)
         len = remaining;
     if (len == 0)
         return 0;
-    ssize_t result = nitrofs_read_internal(ptr, f->position, len);
+    ssize_t result = nitrofs_read_internal(f->fs, ptr, f->position, len);
     if (result <= 0)
         return result;
     f->position += result;
@@ -504,20 +863,21 @@ int nitrofs_close(int fd)
     return 0;
 }
 
-static int nitrofs_open_by_id(nitrofs_file_t *f, uint16_t id)
+static int nitrofs_open_by_id(nitrofs_t *fs, nitrofs_file_t *f, uint16_t id)
 {
     if (id >= 0xF000)
     {
         // not a file
         return -1;
     }
-    nitrofs_read_internal(f, nitrofs_local.fat_offset + (id * 8), 8);
+    nitrofs_read_internal(fs, f, fs->fat_offset + (id * 8), 8);
     f->position = f->offset;
     f->file_index = id;
+    f->fs = fs;
     return 0;
 }
 
-int nitroFSOpenById(uint16_t id)
+static int nitrofs_open_fd(nitrofs_t *fs, uint16_t id)
 {
     nitrofs_file_t *f = malloc(sizeof(nitrofs_file_t));
     if (f == NULL)
@@ -526,7 +886,7 @@ int nitroFSOpenById(uint16_t id)
         return -1;
     }
 
-    int32_t res = nitrofs_open_by_id(f, id);
+    int32_t res = nitrofs_open_by_id(fs, f, id);
     if (res < 0)
     {
         free(f);
@@ -537,6 +897,11 @@ int nitroFSOpenById(uint16_t id)
     return FD_DESC(f) | (FD_TYPE_NITRO << 28);
 }
 
+int nitroFSOpenById(uint16_t id)
+{
+    return nitrofs_open_fd(&nitrofs_local, id);
+}
+
 FILE *nitroFSFopenById(uint16_t id, const char *mode)
 {
     int fd = nitroFSOpenById(id);
@@ -547,19 +912,13 @@ FILE *nitroFSFopenById(uint16_t id, const char *mode)
 
 int nitrofs_open(const char *name)
 {
-    if (!nitrofs_local.fnt_offset)
-    {
-        errno = ENODEV;
-        return -1;
-    }
+    nitrofs_t *fs;
 
-    int32_t res = nitrofs_path_resolve(name);
+    int32_t res = nitrofs_resolve(name, &fs);
     if (res < 0)
-    {
-        errno = ENOENT;
-        return -1;
-    }
-    return nitroFSOpenById(res);
+        return -1; // errno has already been set
+
+    return nitrofs_open_fd(fs, res);
 }
 
 static int nitrofs_stat_file_internal(nitrofs_file_t *f, struct stat *st)
@@ -577,18 +936,9 @@ static int nitrofs_stat_file_internal(nitrofs_file_t *f, struct stat *st)
 
 int nitrofs_fat_get_attr(const char *name)
 {
-    if (!nitrofs_local.fnt_offset)
-    {
-        errno = ENODEV;
-        return -1;
-    }
-
     int32_t res = nitrofs_path_resolve(name);
     if (res < 0)
-    {
-        errno = ENOENT;
-        return -1;
-    }
+        return -1; // errno has already been set
 
     if (res >= 0xF000)
         return ATTR_DIRECTORY | ATTR_READONLY;
@@ -598,18 +948,13 @@ int nitrofs_fat_get_attr(const char *name)
 
 int nitrofs_stat(const char *name, struct stat *st)
 {
-    if (!nitrofs_local.fnt_offset)
-    {
-        errno = ENODEV;
-        return -1;
-    }
-
+    nitrofs_t *fs;
     nitrofs_file_t f;
-    int32_t res = nitrofs_path_resolve(name);
+
+    int32_t res = nitrofs_resolve(name, &fs);
     if (res < 0)
     {
-        errno = ENOENT;
-        return -1;
+        return -1; // errno has already been set
     }
     else if (res >= 0xF000)
     {
@@ -618,7 +963,7 @@ int nitrofs_stat(const char *name, struct stat *st)
         st->st_mode = S_IFDIR;
         return 0;
     }
-    res = nitrofs_open_by_id(&f, res);
+    res = nitrofs_open_by_id(fs, &f, res);
     if (res < 0)
     {
         errno = ENOENT;
@@ -635,30 +980,200 @@ int nitrofs_fstat(int fd, struct stat *st)
 
 /// Initialization
 
-bool nitroFSExit(void)
+// Closes an image and frees the memory used by it. The drive name is kept.
+static bool nitrofs_image_close(nitrofs_t *fs)
 {
-    if (nitrofs_local.fat_offset == 0)
-        return true;
-
-    if (nitrofs_local.file)
+    if (fs->file)
     {
         // TODO: Should we crash here if it fails? It could be leaving a file
         // descriptor open forever.
-        if (fclose(nitrofs_local.file) != 0)
+        if (fclose(fs->file) != 0)
             return false;
+        fs->file = NULL;
     }
 
-    nitrofs_local.fnt_offset = 0;
-    nitrofs_local.fat_offset = 0;
+    free(fs->index);
+    free(fs->fnt_cache);
+    free(fs->fat_cache);
+    fs->index = NULL;
+    fs->fnt_cache = NULL;
+    fs->fat_cache = NULL;
+
+    fs->fnt_offset = 0;
+    fs->fat_offset = 0;
     return true;
 }
 
+// Sets up an image from the offsets and sizes of the FNT and FAT found in the
+// header of the ROM. On error, the image is closed.
+static bool nitrofs_image_setup(nitrofs_t *fs, const uint32_t *nitrofs_offsets)
+{
+    // Reset FNT/FAT offsets.
+    fs->fnt_offset = 0;
+    fs->fat_offset = 0;
+    fs->current_dir = 0xF000;
+
+    // Initialize FAT offset, if valid; otherwise exit.
+    if (nitrofs_offsets[2] >= 0x200 && nitrofs_offsets[3] > 0)
+    {
+        fs->fat_offset = nitrofs_offsets[2];
+        fs->fat_size = nitrofs_offsets[3];
+    }
+    else
+    {
+        nitrofs_image_close(fs);
+        errno = ENODEV;
+        return false;
+    }
+
+    // Initialize FNT offset, if valid. Allow opening files by direct ID
+    // even without an FNT.
+    if (nitrofs_offsets[0] >= 0x200 && nitrofs_offsets[1] > 0)
+    {
+        fs->fnt_offset = nitrofs_offsets[0];
+        fs->fnt_size = nitrofs_offsets[1];
+    }
+
+    return true;
+}
+
+// Loads the FNT and FAT of an image to RAM so that resolving paths and opening
+// files doesn't need any access to the storage device, and builds the path
+// index. If there isn't enough RAM the image keeps working, reading the tables
+// from storage.
+static void nitrofs_image_cache_tables(nitrofs_t *fs)
+{
+    if (fs->fnt_offset && fs->fnt_cache == NULL)
+    {
+        uint8_t *cache = malloc(fs->fnt_size);
+        if (cache != NULL)
+        {
+            if (nitrofs_read_internal(fs, cache, fs->fnt_offset, fs->fnt_size) == (ssize_t)fs->fnt_size)
+                fs->fnt_cache = cache;
+            else
+                free(cache);
+        }
+    }
+
+    if (fs->fat_offset && fs->fat_cache == NULL)
+    {
+        uint8_t *cache = malloc(fs->fat_size);
+        if (cache != NULL)
+        {
+            if (nitrofs_read_internal(fs, cache, fs->fat_offset, fs->fat_size) == (ssize_t)fs->fat_size)
+                fs->fat_cache = cache;
+            else
+                free(cache);
+        }
+    }
+
+    nitrofs_image_build_index(fs);
+}
+
+// Returns true if an image is used by any overlay.
+static bool nitrofs_image_in_overlay(const nitrofs_t *fs)
+{
+    for (int i = 0; i < NITROFS_MAX_MOUNTS; i++)
+    {
+        const nitrofs_t *mount = &nitrofs_mounts[i];
+        for (int j = 0; j < mount->layer_count; j++)
+        {
+            if (mount->layers[j] == fs)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+// Gets a free slot for a new drive, given a mount point like "dlc:/" or "dlc:".
+static nitrofs_t *nitrofs_mount_alloc(const char *mountpoint)
+{
+    if (mountpoint == NULL)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    const char *colon = strchr(mountpoint, ':');
+    if (colon == NULL || colon == mountpoint || (colon[1] != '\0' && strcmp(colon + 1, "/")))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    size_t len = colon - mountpoint + 1;
+    if (len > NITROFS_MAX_NAME_LEN)
+    {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+
+    nitrofs_t *fs = nitrofs_find_mount(mountpoint, len);
+    if (fs != NULL)
+    {
+        if (nitrofs_is_mounted(fs) || fs->fat_offset)
+        {
+            errno = EBUSY;
+            return NULL;
+        }
+        return fs;
+    }
+
+    for (int i = 1; i < NITROFS_MAX_MOUNTS; i++)
+    {
+        fs = &nitrofs_mounts[i];
+        if (fs->name[0] == '\0')
+        {
+            memset(fs, 0, sizeof(nitrofs_t));
+            memcpy(fs->name, mountpoint, len);
+            fs->name[len] = '\0';
+            return fs;
+        }
+    }
+
+    errno = ENFILE;
+    return NULL;
+}
+
+// Frees a slot allocated with nitrofs_mount_alloc(). "nitro:" is never freed.
+static void nitrofs_mount_free(nitrofs_t *fs)
+{
+    if (fs == &nitrofs_local)
+        return;
+
+    if (nitrofs_current == fs)
+    {
+        nitrofs_current = &nitrofs_local;
+        current_drive_is_nitrofs = false;
+    }
+
+    fs->name[0] = '\0';
+}
+
+bool nitroFSExit(void)
+{
+    if (nitrofs_local.fat_offset == 0)
+        return true;
+
+    if (nitrofs_image_in_overlay(&nitrofs_local))
+    {
+        errno = EBUSY;
+        return false;
+    }
+
+    return nitrofs_image_close(&nitrofs_local);
+}
+
 bool nitroFSInit(const char *basepath)
 {
     uint32_t nitrofs_offsets[4];
 
     if (nitrofs_local.fat_offset)
-        nitroFSExit();
+    {
+        if (!nitroFSExit())
+            return false;
+    }
 
     nitrofs_local.file = NULL;
     nitrofs_local.current_dir = 0xF000;
@@ -691,15 +1206,14 @@ bool nitroFSInit(const char *basepath)
             // Initialize the FAT lookup cache for NitroFS files.
             //
             // NitroFS files inherently do a lot of seeking, so it's almost
-            // always beneficial. At the same time, for a defragmented drive,
-            // this should only occupy a few dozen bytes.
-            //
-            // FIXME: Move this to the DLDI driver space and remove the 2KB
-            // size limit.
+            // always beneficial. The cache is sized to fit the whole file, so
+            // that all seeks avoid walking the FAT. For a defragmented drive,
+            // this should only occupy a few dozen bytes, which are placed in
+            // the unused DLDI driver space if possible.
             if (nitrofs_local.file == NULL)
                 basepath = NULL;
             else
-                fatInitLookupCacheFile(nitrofs_local.file, 2048);
+                fatInitLookupCacheFile(nitrofs_local.file, 0);
         }
         else
         {
@@ -709,7 +1223,7 @@ bool nitroFSInit(const char *basepath)
 
     // Read FNT/FAT offset/size information.
     if (nitrofs_local.file)
-        nitrofs_read_internal(nitrofs_offsets, 0x40, 4 * sizeof(uint32_t));
+        nitrofs_read_internal(&nitrofs_local, nitrofs_offsets, 0x40, 4 * sizeof(uint32_t));
     else
     {
         memcpy(nitrofs_offsets, &(__NDSHeader->filenameOffset), 4 * sizeof(uint32_t));
@@ -728,37 +1242,131 @@ bool nitroFSInit(const char *basepath)
         }
     }
 
-    // Reset FNT/FAT offsets.
-    nitrofs_local.fnt_offset = 0;
-    nitrofs_local.fat_offset = 0;
+    if (!nitrofs_image_setup(&nitrofs_local, nitrofs_offsets))
+        return false;
 
-    // Initialize FAT offset, if valid; otherwise exit.
-    if (nitrofs_offsets[2] >= 0x200 && nitrofs_offsets[3] > 0)
+    // Set "nitro:/" as default path
+    nitrofs_current = &nitrofs_local;
+    current_drive_is_nitrofs = true;
+
+    return true;
+}
+
+bool nitroFSMount(const char *path, const char *mountpoint)
+{
+    uint32_t nitrofs_offsets[4];
+
+    if (path == NULL)
     {
-        nitrofs_local.fat_offset = nitrofs_offsets[2];
+        errno = EINVAL;
+        return false;
     }
-    else
+
+    nitrofs_t *fs = nitrofs_mount_alloc(mountpoint);
+    if (fs == NULL)
+        return false; // errno has already been set
+
+    fs->file = fopen(path, "r");
+    if (fs->file == NULL)
+    {
+        nitrofs_mount_free(fs);
+        return false; // errno has already been set
+    }
+
+    fatInitLookupCacheFile(fs->file, 0);
+
+    fs->use_slot2 = false;
+
+    if ((nitrofs_read_internal(fs, nitrofs_offsets, 0x40, 4 * sizeof(uint32_t))
+            != 4 * sizeof(uint32_t)) || !nitrofs_image_setup(fs, nitrofs_offsets))
+    {
+        nitrofs_image_close(fs);
+        nitrofs_mount_free(fs);
+        errno = ENODEV;
+        return false;
+    }
+
+    nitrofs_image_cache_tables(fs);
+
+    return true;
+}
+
+bool nitroFSMountOverlay(const char *mountpoint, const char *const *images,
+                         size_t count)
+{
+    if (images == NULL || count == 0 || count > NITROFS_MAX_MOUNTS)
     {
-        if (nitrofs_local.file)
+        errno = EINVAL;
+        return false;
+    }
+
+    nitrofs_t *layers[NITROFS_MAX_MOUNTS];
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const char *name = images[i];
+        const char *colon = (name != NULL) ? strchr(name, ':') : NULL;
+        nitrofs_t *layer = (colon != NULL) ? nitrofs_find_mount(name, colon - name + 1) : NULL;
+
+        // Only images with a FNT can be used. Overlays can't be nested.
+        if (layer == NULL || layer->layer_count != 0 || layer->fnt_offset == 0)
         {
-            fclose(nitrofs_local.file);
-            // TODO: Should we crash here if it fails? It could be leaving a
-            // file descriptor open forever.
+            errno = ENODEV;
+            return false;
         }
 
-        nitrofs_local.fnt_offset = 0;
+        layers[i] = layer;
+    }
+
+    nitrofs_t *fs = nitrofs_mount_alloc(mountpoint);
+    if (fs == NULL)
+        return false; // errno has already been set
+
+    for (size_t i = 0; i < count; i++)
+    {
+        // Images mounted with nitroFSMount() are already cached. "nitro:" is
+        // only cached when it is used in an overlay.
+        nitrofs_image_cache_tables(layers[i]);
+
+        fs->layers[i] = layers[i];
+        fs->layer_dirs[i] = 0xF000;
+    }
+    fs->layer_count = count;
+
+    return true;
+}
+
+bool nitroFSUnmount(const char *mountpoint)
+{
+    const char *colon = (mountpoint != NULL) ? strchr(mountpoint, ':') : NULL;
+    nitrofs_t *fs = (colon != NULL) ? nitrofs_find_mount(mountpoint, colon - mountpoint + 1) : NULL;
+
+    if (fs == NULL)
+    {
         errno = ENODEV;
         return false;
     }
 
-    // Initialize FNT offset, if valid. Allow opening files by direct ID
-    // even without an FNT.
-    if (nitrofs_offsets[0] >= 0x200 && nitrofs_offsets[1] > 0)
-        nitrofs_local.fnt_offset = nitrofs_offsets[0];
+    if (fs == &nitrofs_local)
+        return nitroFSExit();
 
-    // Set "nitro:/" as default path
-    current_drive_is_nitrofs = true;
+    if (fs->layer_count > 0)
+    {
+        fs->layer_count = 0;
+    }
+    else
+    {
+        if (nitrofs_image_in_overlay(fs))
+        {
+            errno = EBUSY;
+            return false;
+        }
+
+        if (!nitrofs_image_close(fs))
+            return false;
+    }
 
+    nitrofs_mount_free(fs);
     return true;
 }
 
@@ -8,13 +8,47 @@
 #include <stdint.h>
 #include <stdio.h>
 
+// Maximum number of NitroFS drives mounted at the same time, including
+// "nitro:" and overlays.
+#define NITROFS_MAX_MOUNTS 4
+// Maximum length of a drive name, including the colon ("nitro:", "dlc:", ...)
+#define NITROFS_MAX_NAME_LEN 8
+
+typedef struct nitrofs nitrofs_t;
+
+// Entry of the path index of an image. "name" is the offset in the FNT cache of
+// the length byte of the name of the entry, or 0 if the slot is empty.
 typedef struct {
+    uint32_t name;
+    uint16_t parent;
+    uint16_t id;
+} nitrofs_index_entry_t;
+
+struct nitrofs {
     FILE *file; // if NULL, use direct cartridge I/O
     uint32_t fnt_offset;
     uint32_t fat_offset;
     uint16_t current_dir;
     bool use_slot2;
-} nitrofs_t;
+    // In-memory copies of the FNT and FAT. If NULL, they are read from the
+    // image every time they are needed.
+    uint8_t *fnt_cache;
+    uint8_t *fat_cache;
+    uint32_t fnt_size;
+    uint32_t fat_size;
+    // Hash table that maps a parent directory and a name to the ID of an
+    // entry. It is built from the FNT cache. If NULL, the directories are
+    // scanned to resolve paths.
+    nitrofs_index_entry_t *index;
+    uint32_t index_mask;
+    // Overlays: list of images searched in order. An image has no layers.
+    nitrofs_t *layers[NITROFS_MAX_MOUNTS];
+    // Overlays: current directory in each layer, 0 if it isn't present
+    uint16_t layer_dirs[NITROFS_MAX_MOUNTS];
+    uint8_t layer_count;
+    // Drive name, including the colon. Empty if the slot isn't in use.
+    char name[NITROFS_MAX_NAME_LEN + 1];
+};
 
 typedef struct {
     uint32_t offset;
@@ -29,6 +63,8 @@ typedef struct {
     uint32_t endofs;
     uint32_t position;
     uint16_t file_index;
+    // image that contains this file
+    nitrofs_t *fs;
 } nitrofs_file_t;
 
 typedef struct
@@ -49,6 +85,8 @@ typedef struct
     uint16_t dir_parent;
     // dotdot offset
     int16_t dotdot_offset;
+    // image that contains this directory
+    nitrofs_t *fs;
 } nitrofs_dir_state_t;
 
 // Forward declarations
@@ -56,6 +94,7 @@ struct dirent;
 struct stat;
 
 bool nitrofs_use_for_path(const char *path);
+bool nitrofs_set_current_drive(const char *drive);
 int32_t nitrofs_path_resolve(const char *path);
 int nitrofs_opendir(nitrofs_dir_state_t *state, const char *name);
 int nitrofs_rewinddir(nitrofs_dir_state_t *state);
@@ -38,3 +38,42 @@ int thrd_join(thrd_t thr, int *res)
 
     return thrd_success;
 }
+
+int thrd_sleep(const struct timespec *duration, struct timespec *remaining)
+{
+    if (nanosleep(duration, remaining) == 0)
+        return 0;
+
+    // Sleeps can't be interrupted by signals, so the only possible error is an
+    // invalid duration. C11 requires a negative value other than -1.
+    return -2;
+}
+
+int cnd_init(cnd_t *cond)
+{
+    cocond_init(cond);
+    return thrd_success;
+}
+
+int cnd_signal(cnd_t *cond)
+{
+    cocond_signal(cond);
+    return thrd_success;
+}
+
+int cnd_broadcast(cnd_t *cond)
+{
+    cocond_broadcast(cond);
+    return thrd_success;
+}
+
+int cnd_wait(cnd_t *cond, mtx_t *mtx)
+{
+    cocond_wait(cond, mtx);
+    return thrd_success;
+}
+
+void cnd_destroy(cnd_t *cond)
+{
+    (void)cond;
+}
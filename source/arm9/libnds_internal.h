@@ -9,11 +9,30 @@
 
 #include <nds/arm9/console.h>
 #include <nds/arm9/input.h>
+#include <nds/arm9/storage_trace.h>
 
 extern ConsoleOutFn libnds_stdout_write, libnds_stderr_write;
 
 void setTransferInputData(touchPosition *touch, u16 buttons);
+void touchSamplingStoppedHandler(void);
 
 extern time_t *punixTime;
 
+// Start of a storage command. The epoch is 0 if tracing wasn't active when the
+// command started. If not, it identifies the call to storageTraceStart() that
+// the command belongs to.
+typedef struct {
+    u32 time;
+    u32 epoch;
+} storage_trace_start_t;
+
+// Returns the start of a storage command, to be passed to storage_trace_end().
+// It does nothing if tracing isn't active.
+storage_trace_start_t storage_trace_begin(void);
+// The command is only recorded if tracing was active when it started, and it
+// hasn't been restarted since then.
+void storage_trace_end(storage_trace_start_t start, StorageTraceDevice device,
+                       StorageTracePath path, bool write, u32 lba, u32 count,
+                       bool error);
+
 #endif // ARM9_LIBNDS_INTERNAL_H__
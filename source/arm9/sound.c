@@ -6,15 +6,22 @@
 
 // Sound Functions
 
+#include <malloc.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <nds/arm9/cache.h>
+#include <nds/arm9/cp15.h>
 #include <nds/arm9/sassert.h>
 #include <nds/arm9/sound.h>
+#include <nds/cothread.h>
 #include <nds/fifocommon.h>
 #include <nds/fifomessages.h>
+#include <nds/interrupts.h>
 #include <nds/system.h>
 
+#include "common/libnds_internal.h"
+
 void soundEnable(void)
 {
     fifoSendValue32(FIFO_SOUND, SOUND_MASTER_ENABLE);
@@ -247,3 +254,222 @@ void soundMicPowerOff(void)
 
     fifoSendValue32(FIFO_SOUND, MIC_SET_POWER_ON | 0);
 }
+
+// Batches are accessed through the uncached mirror of main RAM so that the ARM9
+// and the ARM7 always see the same data without having to manage the cache.
+// They are aligned to cache lines and their size is rounded up to a multiple of
+// the cache line size so that no other data shares cache lines with them.
+
+void micBufferHandler(int bytes, void *user_data);
+
+SoundBatch *soundBatchCreate(unsigned int max_commands)
+{
+    if (max_commands == 0)
+        return NULL;
+
+    size_t size = sizeof(SoundBatch)
+                + max_commands * (sizeof(FifoMessage) + sizeof(s32));
+    size = (size + 31) & ~31;
+
+    SoundBatch *batch = memalign(32, size);
+    if (batch == NULL)
+        return NULL;
+
+    // The ARM7 sends a message when a batch has been applied. The handler of
+    // microphone messages ignores it, but it's needed to remove it from the
+    // queue of received messages.
+    fifoSetDatamsgHandler(FIFO_SOUND, micBufferHandler, 0);
+
+    batch->state = SOUND_BATCH_RECORDING;
+    batch->count = 0;
+    batch->max_count = max_commands;
+
+    DC_FlushRange(batch, size);
+
+    return memUncached(batch);
+}
+
+void soundBatchFree(SoundBatch *batch)
+{
+    if (batch == NULL)
+        return;
+
+    sassert(batch->state != SOUND_BATCH_SUBMITTED,
+            "Batch is still being processed");
+
+    free(memCached(batch));
+}
+
+void soundBatchReset(SoundBatch *batch)
+{
+    sassert(batch->state != SOUND_BATCH_SUBMITTED,
+            "Batch is still being processed");
+
+    batch->count = 0;
+    batch->state = SOUND_BATCH_RECORDING;
+}
+
+// Returns the next free command of a batch, or NULL if there is no space or the
+// batch has already been submitted.
+static FifoMessage *soundBatchNewCommand(SoundBatch *batch)
+{
+    if (batch->state != SOUND_BATCH_RECORDING)
+        return NULL;
+
+    if (batch->count >= batch->max_count)
+        return NULL;
+
+    return &batch->commands[batch->count++];
+}
+
+static int soundBatchAddCommand(SoundBatch *batch, u32 command)
+{
+    FifoMessage *msg = soundBatchNewCommand(batch);
+    if (msg == NULL)
+        return -1;
+
+    msg->type = SOUND_COMMAND_MESSAGE;
+    msg->SoundCommand.command = command;
+
+    return batch->count - 1;
+}
+
+int soundBatchPlaySample(SoundBatch *batch, int channel, const void *data,
+                         SoundFormat format, u32 dataSize, u16 freq, u8 volume,
+                         u8 pan, bool loop, u16 loopPoint)
+{
+    FifoMessage *msg = soundBatchNewCommand(batch);
+    if (msg == NULL)
+        return -1;
+
+    msg->type = SOUND_PLAY_MESSAGE;
+    msg->SoundPlay.channel = channel;
+    msg->SoundPlay.data = data;
+    msg->SoundPlay.freq = freq;
+    msg->SoundPlay.volume = volume;
+    msg->SoundPlay.pan = pan;
+    msg->SoundPlay.loop = loop;
+    msg->SoundPlay.format = format;
+    msg->SoundPlay.loopPoint = loopPoint;
+    msg->SoundPlay.dataSize = dataSize >> 2;
+
+    return batch->count - 1;
+}
+
+int soundBatchPlayPSG(SoundBatch *batch, int channel, DutyCycle cycle, u16 freq,
+                      u8 volume, u8 pan)
+{
+    FifoMessage *msg = soundBatchNewCommand(batch);
+    if (msg == NULL)
+        return -1;
+
+    msg->type = SOUND_PSG_MESSAGE;
+    msg->SoundPsg.channel = channel;
+    msg->SoundPsg.dutyCycle = cycle;
+    msg->SoundPsg.freq = freq;
+    msg->SoundPsg.volume = volume;
+    msg->SoundPsg.pan = pan;
+
+    return batch->count - 1;
+}
+
+int soundBatchPlayNoise(SoundBatch *batch, int channel, u16 freq, u8 volume,
+                        u8 pan)
+{
+    FifoMessage *msg = soundBatchNewCommand(batch);
+    if (msg == NULL)
+        return -1;
+
+    msg->type = SOUND_NOISE_MESSAGE;
+    msg->SoundPsg.channel = channel;
+    msg->SoundPsg.freq = freq;
+    msg->SoundPsg.volume = volume;
+    msg->SoundPsg.pan = pan;
+
+    return batch->count - 1;
+}
+
+int soundBatchPause(SoundBatch *batch, int soundId)
+{
+    return soundBatchAddCommand(batch, SOUND_PAUSE | (soundId << 16));
+}
+
+int soundBatchKill(SoundBatch *batch, int soundId)
+{
+    return soundBatchAddCommand(batch, SOUND_KILL | (soundId << 16));
+}
+
+int soundBatchResume(SoundBatch *batch, int soundId)
+{
+    return soundBatchAddCommand(batch, SOUND_RESUME | (soundId << 16));
+}
+
+int soundBatchSetVolume(SoundBatch *batch, int soundId, u8 volume)
+{
+    return soundBatchAddCommand(batch,
+                                SOUND_SET_VOLUME | (soundId << 16) | volume);
+}
+
+int soundBatchSetPan(SoundBatch *batch, int soundId, u8 pan)
+{
+    return soundBatchAddCommand(batch, SOUND_SET_PAN | (soundId << 16) | pan);
+}
+
+int soundBatchSetFreq(SoundBatch *batch, int soundId, u16 freq)
+{
+    return soundBatchAddCommand(batch, SOUND_SET_FREQ | (soundId << 16) | freq);
+}
+
+bool soundBatchSubmit(SoundBatch *batch)
+{
+    if (batch->state != SOUND_BATCH_RECORDING)
+        return false;
+
+    if (batch->count == 0)
+    {
+        batch->state = SOUND_BATCH_DONE;
+        return true;
+    }
+
+    batch->state = SOUND_BATCH_SUBMITTED;
+
+    // Make sure that the commands are in main RAM before the ARM7 sees them
+    CP15_DrainWriteBuffer();
+
+    FifoMessage msg;
+
+    msg.type = SOUND_BATCH_MESSAGE;
+    msg.SoundBatch.batch = memCached(batch);
+
+    if (!fifoSendDatamsg(FIFO_SOUND, sizeof(msg), (u8 *)&msg))
+    {
+        batch->state = SOUND_BATCH_RECORDING;
+        return false;
+    }
+
+    return true;
+}
+
+bool soundBatchIsDone(const SoundBatch *batch)
+{
+    return batch->state == SOUND_BATCH_DONE;
+}
+
+void soundBatchWait(const SoundBatch *batch)
+{
+    // The ARM7 sends a message when it finishes, so there is no need to check
+    // the state of the batch until the FIFO interrupt happens.
+    while (batch->state == SOUND_BATCH_SUBMITTED)
+        cothread_yield_irq(IRQ_FIFO_NOT_EMPTY);
+}
+
+int soundBatchGetResult(SoundBatch *batch, int index)
+{
+    if (batch->state != SOUND_BATCH_DONE)
+        return -1;
+
+    if ((index < 0) || ((u32)index >= batch->count))
+        return -1;
+
+    return soundBatchResults(batch)[index];
+}
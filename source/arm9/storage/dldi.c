@@ -135,6 +135,45 @@ static bool dldi_arm7_shutdown(void)
     return result != 0;
 }
 
+// Extents are copied here so that the list is in main RAM even if the caller
+// has it in DTCM (in the stack, for example).
+static DISC_EXTENT dldi_arm7_extents[DLDI_LIST_MAX_EXTENTS] ALIGN(32);
+
+static bool dldi_arm7_sectors_list(u32 cmd, const DISC_EXTENT *extents,
+                                   size_t count, bool write)
+{
+    // Cache maintenance is done for all extents before the list is sent and
+    // after the ARM7 has handled all of them.
+    for (size_t i = 0; i < count; i++)
+        DC_FlushRange(extents[i].buffer, extents[i].numSectors * 512);
+
+    fifoMutexAcquire(FIFO_STORAGE);
+
+    memcpy(dldi_arm7_extents, extents, count * sizeof(DISC_EXTENT));
+    DC_FlushRange(dldi_arm7_extents, count * sizeof(DISC_EXTENT));
+
+    FifoMessage msg;
+    msg.type = cmd;
+    msg.dldiListParams.extents = dldi_arm7_extents;
+    msg.dldiListParams.count = count;
+
+    fifoSendDatamsg(FIFO_STORAGE, sizeof(msg), (u8 *)&msg);
+
+    fifoWaitValue32Async(FIFO_STORAGE);
+
+    int result = fifoGetValue32(FIFO_STORAGE);
+
+    fifoMutexRelease(FIFO_STORAGE);
+
+    if (!write)
+    {
+        for (size_t i = 0; i < count; i++)
+            DC_InvalidateRange(extents[i].buffer, extents[i].numSectors * 512);
+    }
+
+    return result != 0;
+}
+
 // Driver that sends commands to the ARM7 to perform operations
 DISC_INTERFACE __io_dldi_arm7_interface =
 {
@@ -201,6 +240,64 @@ const DISC_INTERFACE *dldiGetInternal(void)
     return interface;
 }
 
+static bool dldi_sectors_list(const DISC_EXTENT *extents, size_t count,
+                              bool write)
+{
+    if ((count > 0) && (extents == NULL))
+        return false;
+
+    if (dldi_mode == DLDI_MODE_AUTODETECT)
+        dldiGetInternal();
+
+    if (dldi_mode == DLDI_MODE_ARM7)
+    {
+        u32 cmd = write ? DLDI_WRITE_SECTORS_LIST : DLDI_READ_SECTORS_LIST;
+
+        while (count > 0)
+        {
+            size_t chunk = count;
+            if (chunk > DLDI_LIST_MAX_EXTENTS)
+                chunk = DLDI_LIST_MAX_EXTENTS;
+
+            if (!dldi_arm7_sectors_list(cmd, extents, chunk, write))
+                return false;
+
+            extents += chunk;
+            count -= chunk;
+        }
+
+        return true;
+    }
+
+    const DISC_INTERFACE *io = &_io_dldi_stub.ioInterface;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const DISC_EXTENT *e = &extents[i];
+        bool ret;
+
+        if (write)
+            ret = io->writeSectors(e->sector, e->numSectors, e->buffer);
+        else
+            ret = io->readSectors(e->sector, e->numSectors, e->buffer);
+
+        if (!ret)
+            return false;
+    }
+
+    return true;
+}
+
+bool dldiReadSectorsList(const DISC_EXTENT *extents, size_t count)
+{
+    return dldi_sectors_list(extents, count, false);
+}
+
+bool dldiWriteSectorsList(const DISC_EXTENT *extents, size_t count)
+{
+    return dldi_sectors_list(extents, count, true);
+}
+
 bool dldiIsValid(const DLDI_INTERFACE *io)
 {
     if (io->magicNumber != DLDI_MAGIC_NUMBER)
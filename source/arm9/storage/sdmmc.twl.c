@@ -4,14 +4,21 @@
 // Copyright (C) 2011-2017 Dave Murphy (WinterMute)
 
 #include <stdbool.h>
+#include <malloc.h>
+#include <stdlib.h>
 #include <nds/arm9/cache.h>
 #include <nds/arm9/sdmmc.h>
+#include <nds/cothread.h>
 #include <nds/disc_io.h>
 #include <nds/fifocommon.h>
 #include <nds/fifomessages.h>
+#include <nds/fiforing.h>
+#include <nds/interrupts.h>
 #include <nds/memory.h>
 #include <nds/system.h>
 
+#include "common/libnds_internal.h"
+
 static u32 sdmmc_fifo_value(uint32_t cmd)
 {
     u32 result;
@@ -133,6 +140,247 @@ bool sdmmc_WriteSectors(sec_t sector, sec_t numSectors, const void *buffer)
     return sdmmc_fifo_sectors(SDMMC_SD_WRITE_SECTORS, sector, numSectors, (void *) buffer, true) == 0;
 }
 
+// Queue of asynchronous requests. The results are read from the uncached
+// mirror of main RAM, the ring is managed by the fifoRing functions.
+//
+// The ID of a request is formed by the slot (lower 4 bits) and a counter that
+// is incremented every time a request is added (upper bits), so that IDs of
+// old requests aren't mistaken for new ones using the same slot.
+
+_Static_assert(SDMMC_QUEUE_MAX_REQUESTS == SDMMC_QUEUE_SLOTS,
+               "Wrong number of queue slots");
+
+#define SDMMC_QUEUE_SLOT_BITS   4
+#define SDMMC_QUEUE_SLOT_MASK   ((1 << SDMMC_QUEUE_SLOT_BITS) - 1)
+#define SDMMC_QUEUE_ID_MASK     0x7FFFFFFF
+
+static SdmmcQueueShared *sdmmc_queue = NULL;
+static FifoRing *sdmmc_queue_ring = NULL;
+
+static u32 sdmmc_queue_counter;
+static u32 sdmmc_queue_busy; // Bitmap of slots in use
+static int sdmmc_queue_id[SDMMC_QUEUE_SLOTS];
+static void *sdmmc_queue_buffer[SDMMC_QUEUE_SLOTS];
+static u32 sdmmc_queue_size[SDMMC_QUEUE_SLOTS];
+static bool sdmmc_queue_write[SDMMC_QUEUE_SLOTS];
+
+// Taken while the queue is being set up. Setting it up requires waiting for the
+// ARM7, so other threads could try to set it up at the same time.
+static comutex_t sdmmc_queue_init_mutex;
+
+// The ARM7 sends the address of the queue in FIFO_STORAGE when it finishes a
+// batch of requests. Address messages aren't used by any other command of this
+// channel, so they can't be mistaken for the answer to a synchronous command.
+// The results are read from shared memory, the message is only used to wake up
+// the threads that wait in sdmmc_QueueWait().
+static void sdmmc_queue_done_handler(void *address, void *userdata)
+{
+    (void)address;
+    (void)userdata;
+}
+
+static bool sdmmc_queue_init_locked(void)
+{
+    size_t size = sizeof(SdmmcQueueShared) + sizeof(FifoRing)
+                + SDMMC_QUEUE_RING_SIZE;
+
+    u8 *mem = memalign(32, size);
+    if (mem == NULL)
+        return false;
+
+    // The ring is initialized (and flushed from the cache) by fifoRingInit()
+    DC_FlushRange(mem, sizeof(SdmmcQueueShared));
+    SdmmcQueueShared *queue = memUncached(mem);
+    for (int i = 0; i < SDMMC_QUEUE_SLOTS; i++)
+    {
+        queue->results[i].done = 1;
+        queue->results[i].result = 0;
+    }
+
+    FifoRing *ring = fifoRingInit(mem + sizeof(SdmmcQueueShared),
+                                  sizeof(FifoRing) + SDMMC_QUEUE_RING_SIZE,
+                                  FIFO_STORAGE, SDMMC_QUEUE_DOORBELL);
+    if (ring == NULL)
+    {
+        free(mem);
+        return false;
+    }
+
+    FifoMessage msg;
+
+    msg.type = SDMMC_QUEUE_SETUP;
+    msg.sdQueueParams.queue = mem;
+
+    fifoSetAddressHandler(FIFO_STORAGE, sdmmc_queue_done_handler, NULL);
+
+    fifoMutexAcquire(FIFO_STORAGE);
+
+    fifoSendDatamsg(FIFO_STORAGE, sizeof(msg), (u8 *)&msg);
+    fifoWaitValue32Async(FIFO_STORAGE);
+    fifoGetValue32(FIFO_STORAGE);
+
+    fifoMutexRelease(FIFO_STORAGE);
+
+    sdmmc_queue_ring = ring;
+    sdmmc_queue = queue;
+
+    return true;
+}
+
+static bool sdmmc_queue_init(void)
+{
+    if (sdmmc_queue != NULL)
+        return true;
+
+    comutex_acquire(&sdmmc_queue_init_mutex);
+
+    bool ret = true;
+
+    // Check it again in case another thread has set up the queue while this
+    // thread was waiting for the mutex.
+    if (sdmmc_queue == NULL)
+        ret = sdmmc_queue_init_locked();
+
+    comutex_release(&sdmmc_queue_init_mutex);
+
+    return ret;
+}
+
+static int sdmmc_queue_add(int device, sec_t sector, sec_t numSectors,
+                           void *buffer, bool write)
+{
+    // The ARM7 ignores the queue messages in DS mode
+    if (!isDSiMode())
+        return -1;
+
+    if ((device != SDMMC_DEVICE_SD) && (device != SDMMC_DEVICE_NAND))
+        return -1;
+
+    if ((numSectors == 0) || (numSectors > 0xFFFF) || (buffer == NULL))
+        return -1;
+
+    if (!sdmmc_queue_init())
+        return -1;
+
+    int oldIME = enterCriticalSection();
+
+    // Look for a free slot
+    u32 slot = 0;
+    while ((slot < SDMMC_QUEUE_SLOTS) && (sdmmc_queue_busy & BIT(slot)))
+        slot++;
+
+    if (slot == SDMMC_QUEUE_SLOTS)
+    {
+        leaveCriticalSection(oldIME);
+        return -1;
+    }
+
+    sdmmc_queue_busy |= BIT(slot);
+
+    sdmmc_queue_counter++;
+    int id = ((sdmmc_queue_counter << SDMMC_QUEUE_SLOT_BITS) | slot)
+             & SDMMC_QUEUE_ID_MASK;
+
+    leaveCriticalSection(oldIME);
+
+    u32 size = numSectors * 512;
+
+    sdmmc_queue_id[slot] = id;
+    sdmmc_queue_buffer[slot] = buffer;
+    sdmmc_queue_size[slot] = size;
+    sdmmc_queue_write[slot] = write;
+
+    DC_FlushRange(buffer, size);
+
+    sdmmc_queue->results[slot].done = 0;
+
+    SdmmcQueueEntry entry = {
+        .slot = slot,
+        .device = device,
+        .write = write,
+        .sector = sector,
+        .count = numSectors,
+        .buffer = buffer,
+    };
+
+    // There is always space for all slots in the ring, but the ring is shared
+    // by all threads.
+    oldIME = enterCriticalSection();
+    bool ret = fifoRingWrite(sdmmc_queue_ring, &entry, sizeof(entry));
+    leaveCriticalSection(oldIME);
+
+    if (!ret)
+    {
+        sdmmc_queue->results[slot].done = 1;
+        sdmmc_queue_id[slot] = -1;
+        sdmmc_queue_busy &= ~BIT(slot);
+        return -1;
+    }
+
+    return id;
+}
+
+int sdmmc_QueueReadSectors(int device, sec_t sector, sec_t numSectors,
+                           void *buffer)
+{
+    return sdmmc_queue_add(device, sector, numSectors, buffer, false);
+}
+
+int sdmmc_QueueWriteSectors(int device, sec_t sector, sec_t numSectors,
+                            const void *buffer)
+{
+    return sdmmc_queue_add(device, sector, numSectors, (void *)buffer, true);
+}
+
+// Returns the slot used by a request, or -1 if the ID isn't valid
+static int sdmmc_queue_slot(int id)
+{
+    if ((id < 0) || (sdmmc_queue == NULL))
+        return -1;
+
+    int slot = id & SDMMC_QUEUE_SLOT_MASK;
+
+    if (((sdmmc_queue_busy & BIT(slot)) == 0) || (sdmmc_queue_id[slot] != id))
+        return -1;
+
+    return slot;
+}
+
+bool sdmmc_QueueIsDone(int id)
+{
+    int slot = sdmmc_queue_slot(id);
+    if (slot < 0)
+        return true;
+
+    return sdmmc_queue->results[slot].done != 0;
+}
+
+bool sdmmc_QueueWait(int id)
+{
+    int slot = sdmmc_queue_slot(id);
+    if (slot < 0)
+        return false;
+
+    // Don't use cothread_yield() here. Threads with lower priority than this
+    // one would never run.
+    while (sdmmc_queue->results[slot].done == 0)
+        cothread_yield_irq(IRQ_FIFO_NOT_EMPTY);
+
+    // The ARM7 may have written to the buffer while the ARM9 had it in the
+    // cache.
+    if (!sdmmc_queue_write[slot])
+        DC_InvalidateRange(sdmmc_queue_buffer[slot], sdmmc_queue_size[slot]);
+
+    int result = sdmmc_queue->results[slot].result;
+
+    int oldIME = enterCriticalSection();
+    sdmmc_queue_id[slot] = -1;
+    sdmmc_queue_busy &= ~BIT(slot);
+    leaveCriticalSection(oldIME);
+
+    return result == 0;
+}
+
 /* const DISC_INTERFACE __io_dsinand = {
     DEVICE_TYPE_DSI_SD,
     FEATURE_MEDIUM_CANREAD | FEATURE_MEDIUM_CANWRITE,
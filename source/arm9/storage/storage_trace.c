@@ -0,0 +1,268 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <nds/arm9/storage_trace.h>
+#include <nds/debug.h>
+#include <nds/interrupts.h>
+#include <nds/timers.h>
+
+#include "arm9/libnds_internal.h"
+
+static StorageTraceRecord *trace_ring = NULL;
+static size_t trace_size;
+static u32 trace_total; // Also used as write index of the ring
+static bool trace_active;
+static u32 trace_epoch; // Incremented by storageTraceStart(), never 0
+
+static u32 trace_histogram[STORAGE_TRACE_NUM_DEVICES][2]
+                          [STORAGE_TRACE_HISTOGRAM_BINS];
+
+bool storageTraceStart(size_t max_records)
+{
+    storageTraceFree();
+
+    if (max_records == 0)
+        return false;
+
+    trace_ring = malloc(max_records * sizeof(StorageTraceRecord));
+    if (trace_ring == NULL)
+        return false;
+
+    trace_size = max_records;
+    trace_total = 0;
+
+    for (int d = 0; d < STORAGE_TRACE_NUM_DEVICES; d++)
+    {
+        for (int w = 0; w < 2; w++)
+        {
+            for (int i = 0; i < STORAGE_TRACE_HISTOGRAM_BINS; i++)
+                trace_histogram[d][w][i] = 0;
+        }
+    }
+
+    trace_epoch++;
+    if (trace_epoch == 0)
+        trace_epoch = 1;
+
+    trace_active = true;
+
+    return true;
+}
+
+void storageTraceStop(void)
+{
+    trace_active = false;
+}
+
+void storageTraceFree(void)
+{
+    trace_active = false;
+
+    free(trace_ring);
+    trace_ring = NULL;
+    trace_size = 0;
+    trace_total = 0;
+}
+
+u32 storageTraceGetTotal(void)
+{
+    return trace_total;
+}
+
+storage_trace_start_t storage_trace_begin(void)
+{
+    storage_trace_start_t start = { 0, 0 };
+
+    if (!trace_active)
+        return start;
+
+    start.time = cpuGetTiming();
+    start.epoch = trace_epoch;
+    return start;
+}
+
+void storage_trace_end(storage_trace_start_t start, StorageTraceDevice device,
+                       StorageTracePath path, bool write, u32 lba, u32 count,
+                       bool error)
+{
+    // Skip commands that started before tracing was started or restarted. Their
+    // start time is missing or belongs to a different trace.
+    if (!trace_active || (start.epoch != trace_epoch))
+        return;
+
+    u32 duration = cpuGetTiming() - start.time;
+
+    // Index of the most significant bit of the duration in microseconds
+    u32 usec = timerTicks2usec(duration);
+    u32 bin = usec < 2 ? 0 : 31 - __builtin_clz(usec);
+    if (bin >= STORAGE_TRACE_HISTOGRAM_BINS)
+        bin = STORAGE_TRACE_HISTOGRAM_BINS - 1;
+
+    int oldIME = enterCriticalSection();
+
+    trace_histogram[device][write ? 1 : 0][bin]++;
+
+    StorageTraceRecord *r = &trace_ring[trace_total % trace_size];
+    r->timestamp = start.time;
+    r->duration = duration;
+    r->lba = lba;
+    r->count = count;
+    r->device = device;
+    r->path = path;
+    r->write = write ? 1 : 0;
+    r->error = error ? 1 : 0;
+
+    trace_total++;
+
+    leaveCriticalSection(oldIME);
+}
+
+size_t storageTraceGetRecords(StorageTraceRecord *records, size_t max_records)
+{
+    if ((records == NULL) || (trace_ring == NULL))
+        return 0;
+
+    int oldIME = enterCriticalSection();
+
+    size_t available = trace_total < trace_size ? trace_total : trace_size;
+    size_t first = trace_total - available;
+
+    size_t count = available < max_records ? available : max_records;
+    for (size_t i = 0; i < count; i++)
+        records[i] = trace_ring[(first + i) % trace_size];
+
+    leaveCriticalSection(oldIME);
+
+    return count;
+}
+
+bool storageTraceGetHistogram(StorageTraceDevice device, bool write,
+                              u32 bins[STORAGE_TRACE_HISTOGRAM_BINS])
+{
+    if (((unsigned int)device >= STORAGE_TRACE_NUM_DEVICES) || (bins == NULL))
+        return false;
+
+    for (int i = 0; i < STORAGE_TRACE_HISTOGRAM_BINS; i++)
+        bins[i] = trace_histogram[device][write ? 1 : 0][i];
+
+    return true;
+}
+
+static const char *trace_device_name[STORAGE_TRACE_NUM_DEVICES] = {
+    "dldi", "sd", "card"
+};
+
+static const char *trace_path_name[] = {
+    "direct", "bounce", "cache", "arm7"
+};
+
+// Calls the callback with one line of text at a time. The records are read
+// from the ring without copying them, so the ring can't be modified while
+// this runs. Callers must pause tracing.
+static bool trace_dump(bool (*print)(const char *line, void *arg), void *arg)
+{
+    char line[128];
+
+    snprintf(line, sizeof(line),
+             "timestamp,duration_us,device,op,path,lba,count,error\n");
+    if (!print(line, arg))
+        return false;
+
+    if (trace_ring != NULL)
+    {
+        size_t available = trace_total < trace_size ? trace_total : trace_size;
+        size_t first = trace_total - available;
+
+        for (size_t i = 0; i < available; i++)
+        {
+            const StorageTraceRecord *r = &trace_ring[(first + i) % trace_size];
+
+            snprintf(line, sizeof(line), "%lu,%lu,%s,%s,%s,%lu,%lu,%u\n",
+                     r->timestamp, timerTicks2usec(r->duration),
+                     trace_device_name[r->device], r->write ? "write" : "read",
+                     trace_path_name[r->path], r->lba, r->count, r->error);
+            if (!print(line, arg))
+                return false;
+        }
+    }
+
+    for (int d = 0; d < STORAGE_TRACE_NUM_DEVICES; d++)
+    {
+        for (int w = 0; w < 2; w++)
+        {
+            const u32 *bins = trace_histogram[d][w];
+
+            // Skip empty histograms
+            u32 total = 0;
+            for (int i = 0; i < STORAGE_TRACE_HISTOGRAM_BINS; i++)
+                total += bins[i];
+            if (total == 0)
+                continue;
+
+            snprintf(line, sizeof(line), "# histogram %s %s (bin: usec >= 2^bin)\n",
+                     trace_device_name[d], w ? "write" : "read");
+            if (!print(line, arg))
+                return false;
+
+            for (int i = 0; i < STORAGE_TRACE_HISTOGRAM_BINS; i++)
+            {
+                if (bins[i] == 0)
+                    continue;
+
+                snprintf(line, sizeof(line), "# %2d: %lu\n", i, bins[i]);
+                if (!print(line, arg))
+                    return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool trace_print_file(const char *line, void *arg)
+{
+    return fputs(line, arg) >= 0;
+}
+
+bool storageTraceDumpFile(const char *path)
+{
+    bool active = trace_active;
+    trace_active = false;
+
+    bool ret = false;
+
+    FILE *f = fopen(path, "w");
+    if (f != NULL)
+    {
+        ret = trace_dump(trace_print_file, f);
+
+        if (fclose(f) != 0)
+            ret = false;
+    }
+
+    trace_active = active;
+
+    return ret;
+}
+
+static bool trace_print_nocash(const char *line, void *arg)
+{
+    (void)arg;
+
+    nocashMessage(line);
+    return true;
+}
+
+void storageTraceDumpNocash(void)
+{
+    bool active = trace_active;
+    trace_active = false;
+
+    trace_dump(trace_print_nocash, NULL);
+
+    trace_active = active;
+}
@@ -6,14 +6,22 @@
 
 // Key and touch screen input code.
 
+#include <malloc.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include <nds/arm9/cache.h>
 #include <nds/arm9/input.h>
+#include <nds/cothread.h>
+#include <nds/fifocommon.h>
+#include <nds/fifomessages.h>
+#include <nds/fiforing.h>
 #include <nds/ipc.h>
 #include <nds/input.h>
 #include <nds/interrupts.h>
 #include <nds/system.h>
 
+#include "arm9/libnds_internal.h"
 #include "common/libnds_internal.h"
 
 // This is updated whenever the FIFO handler receives a message from the ARM7
@@ -30,13 +38,22 @@ static u16 receivedArm7Buttons = 0xFFFF; // Not pressed
 static touchPosition latchedTouchPosition;
 static u16 latchedArm7Buttons = 0xFFFF;
 
-static uint16_t keys_cur(void)
+_Static_assert(KEYS_SHARED_HISTORY_SIZE == INPUT_SHARED_HISTORY_SIZE,
+               "Wrong size of input history");
+
+// Uncached pointer to the block shared with the ARM7. It is kept allocated
+// after the shared mode is disabled because the ARM7 may be updating it.
+static InputSharedBlock *inputSharedBlock = NULL;
+static bool inputSharedEnabled = false;
+
+// Converts the values of REG_KEYINPUT and REG_KEYXY to KEYPAD_BITS
+static uint16_t keys_from_registers(uint16_t keyinput, uint16_t keyxy)
 {
     const uint16_t keyinput_mask = KEY_A | KEY_B | KEY_SELECT | KEY_START |
         KEY_RIGHT | KEY_LEFT | KEY_UP | KEY_DOWN | KEY_R | KEY_L;
 
-    uint16_t keyinput = ~REG_KEYINPUT;
-    uint16_t keyxy = ~latchedArm7Buttons;
+    keyinput = ~keyinput;
+    keyxy = ~keyxy;
 
     uint16_t keys_arm9 = keyinput & keyinput_mask;
 
@@ -53,6 +70,41 @@ static uint16_t keys_cur(void)
     return keys_arm9 | keys_arm7_xy | keys_arm7_debug | keys_arm7_touch_lid;
 }
 
+static uint16_t keys_cur(void)
+{
+    return keys_from_registers(REG_KEYINPUT, latchedArm7Buttons);
+}
+
+// Copies the latest sample from the shared block. It returns false if the ARM7
+// hasn't written any sample yet.
+static bool inputSharedReadLatest(InputSharedSample *sample)
+{
+    InputSharedBlock *block = inputSharedBlock;
+    u32 seq;
+
+    do
+    {
+        seq = block->sequence;
+        if (seq & 1)
+            continue;
+
+        // Only the sequence counter is volatile. Prevent the compiler from
+        // moving the accesses to the rest of the block before or after it.
+        asm volatile("" ::: "memory");
+
+        u32 count = block->count;
+        if (count == 0)
+            return false;
+
+        *sample = block->history[(count - 1) & (INPUT_SHARED_HISTORY_SIZE - 1)];
+
+        asm volatile("" ::: "memory");
+    }
+    while ((seq & 1) || (seq != block->sequence));
+
+    return true;
+}
+
 static uint16_t keys = 0;
 static uint16_t keysold = 0;
 static uint16_t keysrepeat = 0;
@@ -64,8 +116,17 @@ void scanKeys(void)
     int oldIME = enterCriticalSection();
 
     // Get current copy of ARM7 input
-    latchedTouchPosition = receivedTouchPosition;
-    latchedArm7Buttons = receivedArm7Buttons;
+    InputSharedSample sample;
+    if (inputSharedEnabled && inputSharedReadLatest(&sample))
+    {
+        latchedTouchPosition = sample.touch;
+        latchedArm7Buttons = sample.keyxy;
+    }
+    else
+    {
+        latchedTouchPosition = receivedTouchPosition;
+        latchedArm7Buttons = receivedArm7Buttons;
+    }
 
     keysold = keys;
     keys = keys_cur();
@@ -140,3 +201,183 @@ void setTransferInputData(touchPosition *touch, u16 buttons)
     receivedTouchPosition = *touch;
     receivedArm7Buttons = buttons;
 }
+
+static void inputSharedSend(InputSharedBlock *block)
+{
+    FifoMessage msg;
+
+    msg.type = SYS_SET_INPUT_SHARED;
+    msg.setInputShared.block = block;
+
+    fifoSendDatamsg(FIFO_SYSTEM, sizeof(msg), (u8 *)&msg);
+}
+
+bool keysEnableSharedInput(void)
+{
+    if (inputSharedBlock == NULL)
+    {
+        // The block is aligned to cache lines and its size is rounded up so
+        // that no other data shares cache lines with it.
+        size_t size = (sizeof(InputSharedBlock) + 31) & ~31;
+
+        InputSharedBlock *block = memalign(32, size);
+        if (block == NULL)
+            return false;
+
+        memset(block, 0, size);
+
+        // Flush the block and use the uncached mirror so that there is no need
+        // to manage the cache when reading it.
+        DC_FlushRange(block, size);
+
+        inputSharedBlock = memUncached(block);
+    }
+
+    inputSharedEnabled = true;
+
+    inputSharedSend(memCached(inputSharedBlock));
+
+    return true;
+}
+
+void keysDisableSharedInput(void)
+{
+    if (!inputSharedEnabled)
+        return;
+
+    inputSharedSend(NULL);
+
+    inputSharedEnabled = false;
+}
+
+int keysGetHistory(InputSample *samples, int max_samples)
+{
+    if ((samples == NULL) || (max_samples <= 0) || !inputSharedEnabled)
+        return 0;
+
+    InputSharedBlock *block = inputSharedBlock;
+    InputSharedSample history[INPUT_SHARED_HISTORY_SIZE];
+    u32 seq, num;
+
+    do
+    {
+        seq = block->sequence;
+        if (seq & 1)
+            continue;
+
+        asm volatile("" ::: "memory");
+
+        num = block->count;
+        for (int i = 0; i < INPUT_SHARED_HISTORY_SIZE; i++)
+            history[i] = block->history[i];
+
+        asm volatile("" ::: "memory");
+    }
+    while ((seq & 1) || (seq != block->sequence));
+
+    u32 latest = num - 1;
+
+    if (num > INPUT_SHARED_HISTORY_SIZE)
+        num = INPUT_SHARED_HISTORY_SIZE;
+    if (num > (u32)max_samples)
+        num = max_samples;
+
+    for (u32 i = 0; i < num; i++)
+    {
+        // Start from the latest sample
+        InputSharedSample *src =
+            &history[(latest - i) & (INPUT_SHARED_HISTORY_SIZE - 1)];
+        InputSample *dst = &samples[i];
+
+        dst->index = src->index;
+        dst->vcount = src->vcount;
+        dst->keys = keys_from_registers(src->keyinput, src->keyxy);
+        dst->touch = src->touch;
+    }
+
+    return num;
+}
+
+// Ring buffer used by the high-rate touch sampling mode, written by the ARM7
+static FifoRing *touchSamplingRing = NULL;
+static volatile bool touchSamplingStopped;
+
+void touchSamplingStoppedHandler(void)
+{
+    touchSamplingStopped = true;
+}
+
+static void touchSamplingSend(FifoRing *ring, u32 rate_hz)
+{
+    FifoMessage msg;
+
+    msg.type = SYS_SET_TOUCH_SAMPLING;
+    msg.setTouchSampling.ring = (ring == NULL) ? NULL : memCached(ring);
+    msg.setTouchSampling.rate = rate_hz;
+
+    fifoSendDatamsg(FIFO_SYSTEM, sizeof(msg), (u8 *)&msg);
+}
+
+bool touchSamplingStart(u32 rate_hz, u32 max_samples)
+{
+    if ((rate_hz < TOUCH_SAMPLING_MIN_RATE) || (rate_hz > TOUCH_SAMPLING_MAX_RATE))
+        return false;
+
+    if ((max_samples == 0) || (max_samples > 0x10000))
+        return false;
+
+    touchSamplingStop();
+
+    // The size of TouchSample is a power of two, so the size of the data
+    // buffer of the ring is always a multiple of it.
+    _Static_assert((sizeof(TouchSample) & (sizeof(TouchSample) - 1)) == 0,
+                   "The size of TouchSample must be a power of two");
+
+    size_t size = sizeof(TouchSample);
+    while (size < max_samples * sizeof(TouchSample))
+        size <<= 1;
+
+    void *memory = memalign(32, sizeof(FifoRing) + size);
+    if (memory == NULL)
+        return false;
+
+    FifoRing *ring = fifoRingInit(memory, sizeof(FifoRing) + size,
+                                  FIFO_RING_NO_DOORBELL, 0);
+    if (ring == NULL)
+    {
+        free(memory);
+        return false;
+    }
+
+    touchSamplingRing = ring;
+    touchSamplingSend(ring, rate_hz);
+
+    return true;
+}
+
+void touchSamplingStop(void)
+{
+    if (touchSamplingRing == NULL)
+        return;
+
+    // Wait until the ARM7 stops using the ring before freeing it
+    touchSamplingStopped = false;
+    touchSamplingSend(NULL, 0);
+
+    while (!touchSamplingStopped)
+        cothread_yield_irq(IRQ_FIFO_NOT_EMPTY);
+
+    free(memCached(touchSamplingRing));
+    touchSamplingRing = NULL;
+}
+
+int touchSamplingRead(TouchSample *samples, int max_samples)
+{
+    if ((samples == NULL) || (max_samples <= 0) || (touchSamplingRing == NULL))
+        return 0;
+
+    size_t size = fifoRingRead(touchSamplingRing, samples,
+                               max_samples * sizeof(TouchSample));
+
+    return size / sizeof(TouchSample);
+}
@@ -40,6 +40,9 @@ void systemValueHandler(u32 value, void *data)
             if (SDcallback)
                 SDcallback(0);
             break;
+        case SYS_TOUCH_SAMPLING_STOPPED:
+            touchSamplingStoppedHandler();
+            break;
         case SYS_ARM7_CRASH:
         {
             REG_IME = 0;
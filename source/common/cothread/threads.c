@@ -19,6 +19,7 @@
 #include <nds/cothread.h>
 #include <nds/interrupts.h>
 #include <nds/ndstypes.h>
+#include <nds/timers.h>
 
 // Generate a reference to __retarget_lock_acquire(). This will force the linker
 // to add the version of the function included in libnds.
@@ -126,15 +127,13 @@ volatile uint32_t cothread_irq_flags;
 volatile uint32_t cothread_irq_aux_flags;
 #endif
 
-// This function returns true if there is any thread that isn't waiting for an
-// interrupt to happen, false otherwise.
+// This function clears the interrupts that have happened from the flags of all
+// threads that are waiting for them.
 #ifdef ARM9
 ITCM_CODE
 #endif
-static bool cothread_scheduler_refresh_irq_flags(void)
+static void cothread_scheduler_refresh_irq_flags(void)
 {
-    bool any_thread_available = false;
-
     // We need to fetch and clear the current flags in a critical section in
     // case there is an interrupt right when we are reading and clearing the
     // variable.
@@ -160,16 +159,517 @@ static bool cothread_scheduler_refresh_irq_flags(void)
         if (p->wait_irq_aux_flags)
             p->wait_irq_aux_flags &= ~flags_aux;
 #endif
+    }
+}
+
+//-------------------------------------------------------------------
+
+// Sleeping threads are kept in a list sorted by the time when they have to wake
+// up. The time is measured in ticks of a hardware timer (BUS_CLOCK / 64, around
+// 1.9 microseconds). The timer is programmed to generate an interrupt when the
+// first thread of the list has to wake up, or after 0x10000 ticks if that is
+// too far away. It is stopped when no thread is sleeping.
+//
+// The current time is "cothread_sleep_base" plus the ticks that have passed
+// since the timer was last started or overflowed.
+
+static int cothread_sleep_timer = COTHREAD_SLEEP_TIMER_DEFAULT;
+static bool cothread_sleep_timer_running;
+
+static volatile uint64_t cothread_sleep_base;
+static uint16_t cothread_sleep_reload;
+static uint64_t cothread_sleep_fire; // Time of the next interrupt
+
+static cothread_info_t *cothread_sleep_list;
+
+static void cothread_sleep_timer_handler(void)
+{
+    // The timer has overflowed and it has been reloaded automatically.
+    cothread_sleep_base += 0x10000 - cothread_sleep_reload;
+}
+
+// Must be called with IRQs disabled
+#ifdef ARM9
+ITCM_CODE
+#endif
+static uint64_t cothread_sleep_now(void)
+{
+    if (!cothread_sleep_timer_running)
+        return cothread_sleep_base;
+
+    int timer = cothread_sleep_timer;
+
+    // If the timer has overflowed but the interrupt handler hasn't run yet,
+    // add the ticks of the overflow here.
+    uint16_t c1 = TIMER_DATA(timer);
+    bool pending = REG_IF & IRQ_TIMER(timer);
+    uint16_t c2 = TIMER_DATA(timer);
+
+    uint64_t base = cothread_sleep_base;
+    if (pending || (c2 < c1))
+        base += 0x10000 - cothread_sleep_reload;
+
+    return base + (uint16_t)(c2 - cothread_sleep_reload);
+}
+
+// Must be called with IRQs disabled
+#ifdef ARM9
+ITCM_CODE
+#endif
+static void cothread_sleep_timer_start(uint64_t now, uint64_t deadline)
+{
+    int timer = cothread_sleep_timer;
+
+    uint64_t delta = (deadline > now) ? deadline - now : 1;
+    if (delta > 0x10000)
+        delta = 0x10000;
+
+    TIMER_CR(timer) = 0;
+
+    // The handler is installed every time the timer starts in case the
+    // application has used the timer while no thread was sleeping.
+    if (!cothread_sleep_timer_running)
+    {
+        irqSet(IRQ_TIMER(timer), cothread_sleep_timer_handler);
+        irqEnable(IRQ_TIMER(timer));
+    }
+
+    cothread_sleep_base = now;
+    cothread_sleep_reload = 0x10000 - delta;
+    cothread_sleep_fire = now + delta;
+    cothread_sleep_timer_running = true;
+
+    TIMER_DATA(timer) = cothread_sleep_reload;
+    REG_IF = IRQ_TIMER(timer); // Discard overflows of the old configuration
+    TIMER_CR(timer) = TIMER_ENABLE | TIMER_IRQ_REQ | TIMER_DIV_64;
+}
+
+// Must be called with IRQs disabled
+#ifdef ARM9
+ITCM_CODE
+#endif
+static void cothread_sleep_timer_stop(void)
+{
+    int timer = cothread_sleep_timer;
+
+    // Keep the current time so that it doesn't go backwards
+    cothread_sleep_base = cothread_sleep_now();
+    cothread_sleep_timer_running = false;
+
+    TIMER_CR(timer) = 0;
+    REG_IF = IRQ_TIMER(timer);
+
+    // Leave the timer free for the application
+    irqClear(IRQ_TIMER(timer));
+}
+
+// Wakes up all threads whose time has come, and programs the timer for the
+// next one. Must be called with IRQs disabled.
+#ifdef ARM9
+ITCM_CODE
+#endif
+static void cothread_sleep_refresh(void)
+{
+    uint64_t now = cothread_sleep_now();
+
+    cothread_info_t *head = cothread_sleep_list;
+
+    while ((head != NULL) && (head->wake_time <= now))
+    {
+        head->sleeping = 0;
+        head = head->sleep_next;
+    }
+
+    cothread_sleep_list = head;
+
+    if (head == NULL)
+    {
+        if (cothread_sleep_timer_running)
+            cothread_sleep_timer_stop();
+        return;
+    }
+
+    // Only restart the timer if the first thread needs to wake up before the
+    // next interrupt, or if the interrupt has already happened.
+    if (!cothread_sleep_timer_running || (head->wake_time < cothread_sleep_fire)
+        || (now >= cothread_sleep_fire))
+        cothread_sleep_timer_start(now, head->wake_time);
+}
+
+static void cothread_sleep_list_remove(cothread_info_t *ctx)
+{
+    int oldIME = enterCriticalSection();
+
+    cothread_info_t **p = &cothread_sleep_list;
+
+    while (*p != NULL)
+    {
+        if (*p == ctx)
+        {
+            *p = ctx->sleep_next;
+            break;
+        }
+
+        p = (cothread_info_t **)&((*p)->sleep_next);
+    }
+
+    ctx->sleeping = 0;
+
+    if ((cothread_sleep_list == NULL) && cothread_sleep_timer_running)
+        cothread_sleep_timer_stop();
+
+    leaveCriticalSection(oldIME);
+}
+
+int cothread_set_sleep_timer(int timer)
+{
+    if ((timer < 0) || (timer > 3))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (cothread_sleep_list != NULL)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    cothread_sleep_timer = timer;
+
+    return 0;
+}
+
+static void cothread_sleep_ticks(uint64_t ticks)
+{
+    assert(REG_IME != 0); // IRQs must be enabled
+
+    cothread_info_t *ctx = cothread_active_thread;
+
+    int oldIME = enterCriticalSection();
+
+    uint64_t now = cothread_sleep_now();
+
+    ctx->wake_time = now + ticks;
+    ctx->sleeping = 1;
+
+    // Insert the thread in the list, after all threads that wake up at the
+    // same time or earlier.
+    cothread_info_t **p = &cothread_sleep_list;
+    while ((*p != NULL) && ((*p)->wake_time <= ctx->wake_time))
+        p = (cothread_info_t **)&((*p)->sleep_next);
+
+    ctx->sleep_next = *p;
+    *p = ctx;
+
+    if (!cothread_sleep_timer_running || (ctx->wake_time < cothread_sleep_fire))
+        cothread_sleep_timer_start(now, cothread_sleep_list->wake_time);
+
+    leaveCriticalSection(oldIME);
+
+    __ndsabi_coro_yield((void *)ctx, 0);
+}
+
+static void cothread_sleep_usec64(uint64_t usec)
+{
+    if (usec == 0)
+    {
+        cothread_yield();
+        return;
+    }
+
+    // Round up so that threads never wake up too early
+    const uint64_t divisor = 64 * 1000000ULL;
+    uint64_t ticks = (usec * BUS_CLOCK + divisor - 1) / divisor;
+
+    cothread_sleep_ticks(ticks);
+}
+
+void cothread_sleep_us(uint32_t usec)
+{
+    cothread_sleep_usec64(usec);
+}
+
+void cothread_sleep_ms(uint32_t msec)
+{
+    cothread_sleep_usec64((uint64_t)msec * 1000);
+}
+
+//-------------------------------------------------------------------
+
+// Wait queues are linked lists of threads that are blocked until another thread
+// or an interrupt handler wakes them up. The scheduler skips blocked threads.
+// All functions that modify wait queues must be called with IRQs disabled.
+
+// The caller must yield after calling this function.
+static void cothread_wait_queue_add(void **queue, cothread_info_t *ctx)
+{
+    // Add it to the end so that threads with the same priority are woken up in
+    // the order in which they started waiting.
+    void **p = queue;
+    while (*p != NULL)
+        p = &((cothread_info_t *)*p)->wait_next;
+
+    ctx->wait_next = NULL;
+    ctx->wait_queue = queue;
+    *p = ctx;
+}
+
+// Wakes up the waiting thread with the highest priority, and returns it.
+static cothread_info_t *cothread_wait_queue_wake_one(void **queue)
+{
+    void **best = NULL;
+
+    for (void **p = queue; *p != NULL; p = &((cothread_info_t *)*p)->wait_next)
+    {
+        if ((best == NULL) || (((cothread_info_t *)*p)->priority >
+                               ((cothread_info_t *)*best)->priority))
+            best = p;
+    }
+
+    if (best == NULL)
+        return NULL;
+
+    cothread_info_t *ctx = *best;
+
+    *best = ctx->wait_next;
+    ctx->wait_next = NULL;
+    ctx->wait_queue = NULL;
+
+    return ctx;
+}
+
+static void cothread_wait_queue_remove(cothread_info_t *ctx)
+{
+    int oldIME = enterCriticalSection();
+
+    void **p = ctx->wait_queue;
+
+    while (*p != NULL)
+    {
+        if (*p == ctx)
+        {
+            *p = ctx->wait_next;
+            break;
+        }
+
+        p = &((cothread_info_t *)*p)->wait_next;
+    }
+
+    ctx->wait_next = NULL;
+    ctx->wait_queue = NULL;
+
+    leaveCriticalSection(oldIME);
+}
+
+bool comutex_try_acquire(comutex_t *mutex)
+{
+    bool acquired = false;
+
+    int oldIME = enterCriticalSection();
+
+    if (mutex->locked == 0)
+    {
+        mutex->locked = 1;
+        mutex->owner = cothread_active_thread;
+        acquired = true;
+    }
+
+    leaveCriticalSection(oldIME);
+
+    return acquired;
+}
+
+void comutex_acquire(comutex_t *mutex)
+{
+    cothread_info_t *ctx = cothread_active_thread;
+
+    int oldIME = enterCriticalSection();
+
+    if (mutex->locked == 0)
+    {
+        mutex->locked = 1;
+        mutex->owner = ctx;
+        leaveCriticalSection(oldIME);
+        return;
+    }
+
+    assert(mutex->owner != ctx); // Mutexes aren't recursive
+
+    cothread_wait_queue_add(&mutex->waiters, ctx);
+
+    leaveCriticalSection(oldIME);
+
+    // When this thread is resumed, comutex_release() has already passed the
+    // ownership of the mutex to it.
+    __ndsabi_coro_yield((void *)ctx, 0);
+}
+
+void comutex_release(comutex_t *mutex)
+{
+    int oldIME = enterCriticalSection();
+
+    cothread_info_t *ctx = cothread_wait_queue_wake_one(&mutex->waiters);
+    if (ctx != NULL)
+    {
+        mutex->owner = ctx;
+    }
+    else
+    {
+        mutex->locked = 0;
+        mutex->owner = NULL;
+    }
+
+    leaveCriticalSection(oldIME);
+}
+
+void cocond_wait(cocond_t *cond, comutex_t *mutex)
+{
+    cothread_info_t *ctx = cothread_active_thread;
+
+    int oldIME = enterCriticalSection();
+
+    // Start waiting before releasing the mutex so that no signal is lost.
+    cothread_wait_queue_add(&cond->waiters, ctx);
+    comutex_release(mutex);
+
+    leaveCriticalSection(oldIME);
+
+    __ndsabi_coro_yield((void *)ctx, 0);
+
+    comutex_acquire(mutex);
+}
+
+void cocond_signal(cocond_t *cond)
+{
+    int oldIME = enterCriticalSection();
+
+    cothread_wait_queue_wake_one(&cond->waiters);
+
+    leaveCriticalSection(oldIME);
+}
+
+void cocond_broadcast(cocond_t *cond)
+{
+    int oldIME = enterCriticalSection();
+
+    while (cothread_wait_queue_wake_one(&cond->waiters) != NULL)
+        ;
+
+    leaveCriticalSection(oldIME);
+}
+
+bool cosema_try_wait(cosema_t *sema)
+{
+    bool acquired = false;
+
+    int oldIME = enterCriticalSection();
+
+    if (sema->count > 0)
+    {
+        sema->count--;
+        acquired = true;
+    }
+
+    leaveCriticalSection(oldIME);
+
+    return acquired;
+}
+
+void cosema_wait(cosema_t *sema)
+{
+    cothread_info_t *ctx = cothread_active_thread;
+
+    int oldIME = enterCriticalSection();
+
+    if (sema->count > 0)
+    {
+        sema->count--;
+        leaveCriticalSection(oldIME);
+        return;
+    }
+
+    cothread_wait_queue_add(&sema->waiters, ctx);
+
+    leaveCriticalSection(oldIME);
+
+    // When this thread is resumed, cosema_signal() has given the count to it
+    // without incrementing the counter.
+    __ndsabi_coro_yield((void *)ctx, 0);
+}
+
+void cosema_signal(cosema_t *sema)
+{
+    int oldIME = enterCriticalSection();
+
+    if (cothread_wait_queue_wake_one(&sema->waiters) == NULL)
+        sema->count++;
+
+    leaveCriticalSection(oldIME);
+}
+
+//-------------------------------------------------------------------
+
+// Returns true if the thread can be resumed
+#ifdef ARM9
+ITCM_CODE
+#endif
+static inline bool cothread_is_runnable(const cothread_info_t *ctx)
+{
+    if (ctx->joined)
+        return false;
 
-        if (p->wait_irq_flags == 0)
-            any_thread_available = true;
+    if (ctx->sleeping)
+        return false;
+
+    if (ctx->wait_queue != NULL)
+        return false;
+
+    if (ctx->wait_irq_flags)
+        return false;
 #ifdef ARM7
-        if (p->wait_irq_aux_flags == 0)
-            any_thread_available = true;
+    if (ctx->wait_irq_aux_flags)
+        return false;
 #endif
+
+    return true;
+}
+
+// Returns the thread with the highest priority that can be resumed, or NULL if
+// all threads are waiting. The search starts right after the thread that has
+// run last, so threads with the same priority take turns.
+#ifdef ARM9
+ITCM_CODE
+#endif
+static cothread_info_t *cothread_scheduler_pick(cothread_info_t *last)
+{
+    cothread_scheduler_refresh_irq_flags();
+
+    if (cothread_sleep_list != NULL)
+    {
+        int oldIME = enterCriticalSection();
+        cothread_sleep_refresh();
+        leaveCriticalSection(oldIME);
+    }
+
+    cothread_info_t *best = NULL;
+    cothread_info_t *p = last;
+
+    do
+    {
+        p = p->next;
+        if (p == NULL)
+            p = &cothread_list;
+
+        if (cothread_is_runnable(p))
+        {
+            if ((best == NULL) || (p->priority > best->priority))
+                best = p;
+        }
     }
+    while (p != last);
 
-    return any_thread_available;
+    return best;
 }
 
 //-------------------------------------------------------------------
@@ -229,10 +729,120 @@ static bool cothread_list_contains_ctx(cothread_info_t *ctx)
 
 //-------------------------------------------------------------------
 
+// Each slot of a pool holds the control block of a thread, followed by its TLS
+// and its stack. Free slots are kept in a linked list that uses the "next"
+// field of the control block, as they aren't part of the list of threads.
+
+#define COTHREAD_POOL_ALIGN(size)   (((size) + 7) & ~(size_t)7)
+
+struct cothread_pool
+{
+    void *memory;
+    size_t slot_size;
+    size_t num_slots;
+    size_t used_slots;
+    cothread_info_t *free_list;
+};
+
+cothread_pool_t *cothread_pool_create(size_t num_threads, size_t stack_size)
+{
+    if ((num_threads == 0) || ((stack_size & 7) != 0))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (stack_size == 0)
+        stack_size = DEFAULT_STACK_SIZE_CHILD;
+
+    size_t tls_size = (uintptr_t)__tls_end - (uintptr_t)__tls_start;
+
+    size_t slot_size = COTHREAD_POOL_ALIGN(sizeof(cothread_info_t))
+                     + COTHREAD_POOL_ALIGN(tls_size) + stack_size;
+
+    if (num_threads > SIZE_MAX / slot_size)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    cothread_pool_t *pool = calloc(1, sizeof(cothread_pool_t));
+    if (pool == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // The stacks must be aligned to 8 bytes
+    pool->memory = memalign(8, num_threads * slot_size);
+    if (pool->memory == NULL)
+    {
+        free(pool);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    pool->slot_size = slot_size;
+    pool->num_slots = num_threads;
+    pool->used_slots = 0;
+    pool->free_list = NULL;
+
+    for (size_t i = num_threads; i > 0; i--)
+    {
+        cothread_info_t *ctx = (void *)((uintptr_t)pool->memory
+                                        + (i - 1) * slot_size);
+        ctx->next = pool->free_list;
+        pool->free_list = ctx;
+    }
+
+    return pool;
+}
+
+int cothread_pool_destroy(cothread_pool_t *pool)
+{
+    if (pool == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (pool->used_slots != 0)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    free(pool->memory);
+    free(pool);
+
+    return 0;
+}
+
+static void cothread_pool_release(cothread_pool_t *pool, cothread_info_t *ctx)
+{
+    ctx->next = pool->free_list;
+    pool->free_list = ctx;
+    pool->used_slots--;
+}
+
+//-------------------------------------------------------------------
+
 static void cothread_delete_internal(cothread_info_t *ctx)
 {
     cothread_list_remove_ctx(ctx);
 
+    if (ctx->sleeping)
+        cothread_sleep_list_remove(ctx);
+
+    if (ctx->wait_queue != NULL)
+        cothread_wait_queue_remove(ctx);
+
+    if (ctx->pool != NULL)
+    {
+        cothread_pool_release(ctx->pool, ctx);
+        return;
+    }
+
     if (ctx->stack_base)
         free_fn(ctx->stack_base);
 
@@ -269,6 +879,7 @@ static cothread_t cothread_create_internal(cothread_info_t *ctx,
 {
     ctx->flags = flags;
     ctx->tls = tls;
+    ctx->priority = (int8_t)((flags >> 8) & 0xFF);
 
     // Initialize context
     __ndsabi_coro_make_noctx((void *)ctx, stack_top, entrypoint, arg);
@@ -367,6 +978,40 @@ cothread_t cothread_create(int (*entrypoint)(void *), void *arg,
     return id;
 }
 
+cothread_t cothread_create_pooled(cothread_pool_t *pool,
+                                  cothread_entrypoint_t entrypoint, void *arg,
+                                  unsigned int flags)
+{
+    if ((pool == NULL) || (entrypoint == NULL))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    cothread_info_t *ctx = pool->free_list;
+    if (ctx == NULL)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    pool->free_list = ctx->next;
+    pool->used_slots++;
+
+    memset(ctx, 0, sizeof(cothread_info_t));
+    ctx->pool = pool;
+
+    void *tls = (void *)((uintptr_t)ctx
+                         + COTHREAD_POOL_ALIGN(sizeof(cothread_info_t)));
+    init_tls(tls);
+
+    void *stack_top = (void *)((uintptr_t)ctx + pool->slot_size);
+
+    // Add context to the scheduler
+    cothread_list_add_ctx(ctx);
+
+    return cothread_create_internal(ctx, entrypoint, arg, stack_top, tls, flags);
+}
 
 int cothread_detach(cothread_t thread)
 {
@@ -415,6 +1060,40 @@ int cothread_get_exit_code(cothread_t thread)
     return ctx->arg;
 }
 
+int cothread_set_priority(cothread_t thread, int priority)
+{
+    cothread_info_t *ctx = (cothread_info_t *)thread;
+
+    if ((priority < COTHREAD_PRIORITY_MIN) || (priority > COTHREAD_PRIORITY_MAX))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (!cothread_list_contains_ctx(ctx))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ctx->priority = priority;
+
+    return 0;
+}
+
+int cothread_get_priority(cothread_t thread)
+{
+    cothread_info_t *ctx = (cothread_info_t *)thread;
+
+    if (!cothread_list_contains_ctx(ctx))
+    {
+        errno = EINVAL;
+        return COTHREAD_PRIORITY_DEFAULT;
+    }
+
+    return ctx->priority;
+}
+
 void cothread_yield(void)
 {
     cothread_info_t *ctx = cothread_active_thread;
@@ -456,25 +1135,27 @@ ITCM_CODE
 #endif
 static int cothread_scheduler_start(void)
 {
-    cothread_info_t *ctx = &cothread_list;
+    // Last thread that has run. The search starts from the main() thread.
+    cothread_info_t *last = &cothread_list;
 
     while (1)
     {
-        bool delete_current_thread = false;
-        cothread_info_t *ctx_to_delete = NULL;
+        cothread_info_t *ctx = cothread_scheduler_pick(last);
 
-        // If the thread has finished, skip it
-        if (ctx->joined)
-            goto next_thread;
-
-        // If this thread is waiting for any interrupt to happen, skip it
+        if (ctx == NULL)
+        {
+            // If no thread is active that means that all threads are
+            // waiting for an interrupt to happen. Use BIOS calls to enter
+            // low power mode.
 #ifdef ARM9
-        if (ctx->wait_irq_flags)
-            goto next_thread;
+            CP15_WaitForInterrupt();
 #elif defined(ARM7)
-        if (ctx->wait_irq_flags || ctx->wait_irq_aux_flags)
-            goto next_thread;
+            swiHalt();
 #endif
+            continue;
+        }
+
+        last = ctx;
 
         // Set this thread as the active one and resume it.
         cothread_active_thread = ctx;
@@ -496,39 +1177,21 @@ static int cothread_scheduler_start(void)
             // If it is detached, delete it. If not, save the exit code so that
             // the user can check it later.
             if (ctx->flags & COTHREAD_DETACHED)
-                delete_current_thread = true;
-            else
-                ctx->arg = ret;
-        }
+            {
+                // Continue the search from the previous thread of the list so
+                // that the threads that come after it get their turn.
+                cothread_info_t *prev = &cothread_list;
+                while (prev->next != ctx)
+                    prev = prev->next;
 
-next_thread:
-
-        if (delete_current_thread)
-            ctx_to_delete = ctx;
-
-        bool any_thread_active = true;
-
-        // Get the next thread
-        ctx = ctx->next;
-        if (ctx == NULL)
-        {
-            ctx = &cothread_list;
-            any_thread_active = cothread_scheduler_refresh_irq_flags();
-        }
+                cothread_delete_internal(ctx);
 
-        if (delete_current_thread)
-            cothread_delete_internal(ctx_to_delete);
-
-        if (any_thread_active == false)
-        {
-            // If no thread is active that means that all threads are
-            // waiting for an interrupt to happen. Use BIOS calls to enter
-            // low power mode.
-#ifdef ARM9
-            CP15_WaitForInterrupt();
-#elif defined(ARM7)
-            swiHalt();
-#endif
+                last = prev;
+            }
+            else
+            {
+                ctx->arg = ret;
+            }
         }
     }
 }
@@ -9,6 +9,24 @@
 #include <nds/bios.h>
 #include <nds/decompress.h>
 
+#include "decompress_internal.h"
+
+#ifdef ARM9
+static DecompressBackend decompress_backend = DECOMPRESS_BACKEND_SOFTWARE;
+#else
+static DecompressBackend decompress_backend = DECOMPRESS_BACKEND_BIOS;
+#endif
+
+void decompressSetBackend(DecompressBackend backend)
+{
+    decompress_backend = backend;
+}
+
+DecompressBackend decompressGetBackend(void)
+{
+    return decompress_backend;
+}
+
 static int decompress_get_header(uint8_t *source, uint16_t *dest, uint32_t arg)
 {
     (void)dest;
@@ -43,16 +61,35 @@ TDecompressionStream decomStream =
 
 void decompress(const void *data, void *dst, DecompressType type)
 {
+    // The BIOS doesn't support the extended LZ77 format (type 0x11)
+    bool use_software = decompress_backend == DECOMPRESS_BACKEND_SOFTWARE;
+    if ((type == LZ77) || (type == LZ77Vram))
+        use_software |= (*(const uint8_t *)data) == 0x11;
+
     switch (type)
     {
         case LZ77Vram:
-            swiDecompressLZSSVram(data, dst, 0, &decomStream);
+            if (use_software)
+                decompress_lz77_vram(data, dst);
+            else
+                swiDecompressLZSSVram(data, dst, 0, &decomStream);
             break;
         case LZ77:
-            swiDecompressLZSSWram(data, dst);
+            if (use_software)
+                decompress_lz77_wram(data, dst);
+            else
+                swiDecompressLZSSWram(data, dst);
             break;
         case HUFF:
         {
+            if (use_software)
+            {
+                // The lookup table is allocated in the stack, in DTCM
+                uint32_t table[DECOMPRESS_HUFFMAN_TABLE_SIZE];
+                decompress_huffman(data, dst, table);
+                break;
+            }
+
             // This temporary buffer is allocated in the stack, in DTCM, but
             // that's okay because the ARM9 BIOS can access DTCM.
             uint8_t temp[0x200];
@@ -65,6 +102,12 @@ void decompress(const void *data, void *dst, DecompressType type)
         case RLEVram:
             swiDecompressRLEVram(data, dst, 0, &decomStream);
             break;
+        case LZ4:
+            decompress_lz4_wram(data, dst);
+            break;
+        case LZ4Vram:
+            decompress_lz4_vram(data, dst);
+            break;
         default:
             break;
     }
@@ -79,6 +122,9 @@ void decompressStream(const void *data, void *dst, DecompressType type,
     // HUFF not supported, use decompresStreamStruct()
     assert(type != HUFF);
 
+    // LZ4 isn't supported by the BIOS
+    assert(type != LZ4 && type != LZ4Vram);
+
     TDecompressionStream decompresStream =
     {
         getHeaderCB,
@@ -107,6 +153,9 @@ void decompressStreamStruct(const void *data, void *dst, DecompressType type,
     // LZ77 and RLE do not support streaming, use VRAM versions
     assert(type != LZ77 && type != RLE);
 
+    // LZ4 isn't supported by the BIOS
+    assert(type != LZ4 && type != LZ4Vram);
+
     // getSize() and readByte() callbacks are required
     assert((ds->getSize != NULL) && (ds->readByte != NULL));
 
@@ -0,0 +1,205 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <nds/ndstypes.h>
+
+#include "decompress_internal.h"
+
+// Software Huffman decoder. It supports the format used by the BIOS:
+//
+// - Header: Bits 0-3 are the size of the symbols in bits (4 or 8), bits 4-7 are
+//   the type (2) and bits 8-31 are the size of the decompressed data.
+// - Tree size: Size of the tree in halfwords minus one.
+// - Tree: List of nodes, starting with the root node. In nodes that aren't
+//   data nodes:
+//     Bits 0-5: Offset to the children. Child 0 is at:
+//               (address & ~1) + offset * 2 + 2
+//               Child 1 is right after child 0.
+//     Bit 6:    Child 1 is a data node
+//     Bit 7:    Child 0 is a data node
+// - Bitstream: Stored in 32-bit units, starting from the most significant bit.
+//
+// The output is written in 32-bit units, so it is safe to use VRAM as
+// destination.
+//
+// The BIOS walks the tree one bit at a time. This decoder builds a table that
+// is indexed by the next DECOMPRESS_HUFFMAN_TABLE_BITS bits of the bitstream.
+// Each entry contains all the symbols that can be fully decoded with those
+// bits, so short codes are decoded several at a time. Codes that are longer
+// than that fall back to walking the tree from the node reached by the table.
+//
+// Format of each table entry:
+//
+//   Bits 0-3:  Number of bits used by the symbols of the entry.
+//   Bits 4-7:  Number of symbols. If it is 0, the code is longer than the bits
+//              of the index.
+//   Bits 8-31: Symbols, starting from the least significant bits. If there
+//              aren't symbols, this is the offset of the node reached after
+//              all the bits of the index, relative to the root node.
+
+// Returns the child of a node selected by a bit of the bitstream
+__attribute__((always_inline))
+static inline const uint8_t *decompress_huffman_child(const uint8_t *node,
+                                                      uint32_t bit)
+{
+    uintptr_t addr = (uintptr_t)node & ~(uintptr_t)1;
+    return (const uint8_t *)(addr + ((*node & 0x3F) << 1) + 2 + bit);
+}
+
+// Returns true if the child of a node selected by a bit is a data node
+__attribute__((always_inline))
+static inline bool decompress_huffman_is_data(const uint8_t *node, uint32_t bit)
+{
+    return *node & (0x80 >> bit);
+}
+
+static void decompress_huffman_build_table(const uint8_t *root,
+                                           uint32_t data_bits, uint32_t *table)
+{
+    // All symbols are stored in 24 bits
+    uint32_t max_symbols = 24 / data_bits;
+
+    for (uint32_t index = 0; index < DECOMPRESS_HUFFMAN_TABLE_SIZE; index++)
+    {
+        const uint8_t *node = root;
+        uint32_t symbols = 0;
+        uint32_t count = 0;
+        uint32_t used = 0;
+
+        for (uint32_t i = 0; i < DECOMPRESS_HUFFMAN_TABLE_BITS; i++)
+        {
+            uint32_t bit = (index >> (DECOMPRESS_HUFFMAN_TABLE_BITS - 1 - i)) & 1;
+
+            const uint8_t *child = decompress_huffman_child(node, bit);
+
+            if (decompress_huffman_is_data(node, bit))
+            {
+                symbols |= (uint32_t)*child << (count * data_bits);
+                count++;
+                used = i + 1;
+                node = root;
+
+                if (count == max_symbols)
+                    break;
+            }
+            else
+            {
+                node = child;
+            }
+        }
+
+        if (count == 0)
+        {
+            table[index] = DECOMPRESS_HUFFMAN_TABLE_BITS
+                         | ((uint32_t)(node - root) << 8);
+        }
+        else
+        {
+            table[index] = used | (count << 4) | (symbols << 8);
+        }
+    }
+}
+
+#ifdef ARM9
+ITCM_CODE
+#endif
+ARM_CODE
+void decompress_huffman(const void *src, void *dst, uint32_t *table)
+{
+    const uint8_t *in = src;
+    uint32_t header = *(const uint32_t *)src;
+    uint32_t data_bits = header & 0xF;
+
+    const uint8_t *root = in + 5;
+    const uint32_t *stream = (const uint32_t *)(in + 4 + ((in[4] + 1) << 1));
+
+    decompress_huffman_build_table(root, data_bits, table);
+
+    uint32_t *out = dst;
+    uint32_t *end = out + (((header >> 8) + 3) >> 2);
+
+    // Bits of the bitstream that haven't been used yet, aligned to the most
+    // significant bit. The bits below them are zero.
+    uint32_t bits = 0;
+    uint32_t bit_count = 0;
+
+    // Symbols that haven't been written to the destination yet
+    uint32_t word = 0;
+    uint32_t out_bits = 0;
+
+    while (out < end)
+    {
+        if (bit_count == 0)
+        {
+            bits = *stream++;
+            bit_count = 32;
+        }
+
+        uint32_t entry = table[bits >> (32 - DECOMPRESS_HUFFMAN_TABLE_BITS)];
+        uint32_t used = entry & 0xF;
+        uint32_t count = (entry >> 4) & 0xF;
+        uint32_t symbols;
+
+        if ((used <= bit_count) && (count > 0))
+        {
+            // Fast path: One or more symbols decoded with one lookup
+            bits <<= used;
+            bit_count -= used;
+            symbols = entry >> 8;
+        }
+        else
+        {
+            // The code is too long for the table, or it continues in the next
+            // word of the bitstream. Walk the tree one bit at a time, starting
+            // from the node reached by the table, if possible.
+            const uint8_t *node = root;
+
+            if (used <= bit_count)
+            {
+                bits <<= used;
+                bit_count -= used;
+                node += entry >> 8;
+            }
+
+            while (1)
+            {
+                if (bit_count == 0)
+                {
+                    bits = *stream++;
+                    bit_count = 32;
+                }
+
+                uint32_t bit = bits >> 31;
+                bits <<= 1;
+                bit_count--;
+
+                bool is_data = decompress_huffman_is_data(node, bit);
+                node = decompress_huffman_child(node, bit);
+
+                if (is_data)
+                    break;
+            }
+
+            symbols = *node;
+            count = 1;
+        }
+
+        // Symbols may fill the current output word and continue in the next
+        // one. At most 24 bits are added, so the shift is never 32.
+        uint32_t new_bits = count * data_bits;
+
+        word |= symbols << out_bits;
+        out_bits += new_bits;
+
+        if (out_bits >= 32)
+        {
+            *out++ = word;
+            out_bits -= 32;
+            word = out_bits ? (symbols >> (new_bits - out_bits)) : 0;
+        }
+    }
+}
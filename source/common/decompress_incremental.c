@@ -0,0 +1,391 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <nds/decompress.h>
+#include <nds/ndstypes.h>
+
+#include "decompress_internal.h"
+
+// Incremental decoders of the LZ77, RLE and Huffman formats of the BIOS. They
+// produce the same output as the BIOS routines, but they can stop after any
+// byte (or any 32-bit word, in the case of Huffman) and continue later.
+//
+// All the state that needs to survive between steps is kept in the
+// DecompressIncremental struct. The steps copy it to local variables and save
+// it back when they return, so that the loops work with registers.
+
+// Writes one byte to the destination. In VRAM mode bytes are written in pairs
+// with DECOMPRESS_VRAM_PUT().
+#define INCR_PUT(value)                                             \
+    do {                                                            \
+        if (vram)                                                   \
+        {                                                           \
+            DECOMPRESS_VRAM_PUT(dst, pos, pending, last, value);    \
+        }                                                           \
+        else                                                        \
+        {                                                           \
+            last = (value);                                         \
+            dst[pos++] = last;                                      \
+        }                                                           \
+    } while (0)
+
+// If the size is odd, write the last byte and preserve the byte after it
+static void decompress_incremental_flush(DecompressIncremental *state)
+{
+    if ((state->type == LZ77Vram) || (state->type == RLEVram))
+    {
+        uint8_t *dst = state->dst;
+        DECOMPRESS_VRAM_FLUSH(dst, state->pos, state->pending);
+    }
+}
+
+#ifdef ARM9
+ITCM_CODE
+#endif
+ARM_CODE
+static void decompress_incremental_lz77(DecompressIncremental *state,
+                                        uint32_t end)
+{
+    const uint8_t *src = state->src;
+    uint8_t *dst = state->dst;
+    uint32_t pos = state->pos;
+    uint32_t flags = state->flags;
+    uint32_t flag_count = state->flag_count;
+    uint32_t len = state->run_len;
+    uint32_t disp = state->run_arg;
+    uint32_t pending = state->pending;
+    uint32_t last = state->last;
+
+    bool vram = state->type == LZ77Vram;
+    bool lz11 = state->format == 0x11;
+
+    while (pos < end)
+    {
+        // Continue the reference that was interrupted, if any
+        if (len > 0)
+        {
+            uint32_t count = end - pos;
+            if (count > len)
+                count = len;
+            len -= count;
+
+            do
+            {
+                // The byte that is repeated may not have been written yet
+                INCR_PUT((disp == 1) ? last : dst[pos - disp]);
+            }
+            while (--count);
+
+            continue;
+        }
+
+        if (flag_count == 0)
+        {
+            flags = *src++;
+            flag_count = 8;
+        }
+
+        flag_count--;
+
+        if (flags & (1 << flag_count))
+        {
+            uint32_t b0 = *src++;
+
+            if (lz11)
+            {
+                uint32_t indicator = b0 >> 4;
+
+                if (indicator == 0)
+                {
+                    uint32_t b1 = *src++;
+                    uint32_t b2 = *src++;
+                    len = ((b0 << 4) | (b1 >> 4)) + 0x11;
+                    disp = (((b1 & 0xF) << 8) | b2) + 1;
+                }
+                else if (indicator == 1)
+                {
+                    uint32_t b1 = *src++;
+                    uint32_t b2 = *src++;
+                    uint32_t b3 = *src++;
+                    len = (((b0 & 0xF) << 12) | (b1 << 4) | (b2 >> 4)) + 0x111;
+                    disp = (((b2 & 0xF) << 8) | b3) + 1;
+                }
+                else
+                {
+                    uint32_t b1 = *src++;
+                    len = indicator + 1;
+                    disp = (((b0 & 0xF) << 8) | b1) + 1;
+                }
+            }
+            else
+            {
+                uint32_t b1 = *src++;
+                len = (b0 >> 4) + 3;
+                disp = (((b0 & 0xF) << 8) | b1) + 1;
+            }
+
+            // The BIOS stops as soon as the output is full.
+            if (len > state->size - pos)
+                len = state->size - pos;
+        }
+        else
+        {
+            INCR_PUT(*src++);
+        }
+    }
+
+    state->src = src;
+    state->pos = pos;
+    state->flags = flags;
+    state->flag_count = flag_count;
+    state->run_len = len;
+    state->run_arg = disp;
+    state->pending = pending;
+    state->last = last;
+}
+
+#ifdef ARM9
+ITCM_CODE
+#endif
+ARM_CODE
+static void decompress_incremental_rle(DecompressIncremental *state,
+                                       uint32_t end)
+{
+    const uint8_t *src = state->src;
+    uint8_t *dst = state->dst;
+    uint32_t pos = state->pos;
+    uint32_t len = state->run_len;
+    uint32_t value = state->run_arg;
+    uint32_t pending = state->pending;
+    uint32_t last = state->last;
+
+    bool vram = state->type == RLEVram;
+
+    while (pos < end)
+    {
+        if (len == 0)
+        {
+            // Bit 7 set: Run of (N + 3) copies of the next byte.
+            // Bit 7 clear: (N + 1) uncompressed bytes.
+            uint32_t flag = *src++;
+
+            if (flag & 0x80)
+            {
+                len = (flag & 0x7F) + 3;
+                value = *src++;
+            }
+            else
+            {
+                len = (flag & 0x7F) + 1;
+                value = UINT32_MAX;
+            }
+
+            if (len > state->size - pos)
+                len = state->size - pos;
+        }
+
+        uint32_t count = end - pos;
+        if (count > len)
+            count = len;
+        len -= count;
+
+        if (value == UINT32_MAX)
+        {
+            do
+            {
+                INCR_PUT(*src++);
+            }
+            while (--count);
+        }
+        else
+        {
+            do
+            {
+                INCR_PUT(value);
+            }
+            while (--count);
+        }
+    }
+
+    state->src = src;
+    state->pos = pos;
+    state->run_len = len;
+    state->run_arg = value;
+    state->pending = pending;
+    state->last = last;
+}
+
+#undef INCR_PUT
+
+#ifdef ARM9
+ITCM_CODE
+#endif
+ARM_CODE
+static void decompress_incremental_huffman(DecompressIncremental *state,
+                                           uint32_t end)
+{
+    const uint8_t *src = state->src;
+    uint32_t *dst = (uint32_t *)state->dst;
+    uint32_t pos = state->pos;
+    uint32_t word = state->pending;
+    uint32_t out_bits = state->out_bits;
+    uint32_t bits = state->bits;
+    uint32_t bit_count = state->bit_count;
+
+    const uint8_t *root = state->tree;
+    uint32_t data_bits = state->format & 0xF;
+
+    // The output is written in 32-bit units, so the step may need to write
+    // a few bytes more than requested.
+    while (pos < end)
+    {
+        // Walk the tree from the root until a data node is found. The tree
+        // nodes are:
+        //
+        //   Bits 0-5: Offset to the children. Child 0 is at:
+        //             (address & ~1) + offset * 2 + 2
+        //   Bit 6:    Child 1 is a data node
+        //   Bit 7:    Child 0 is a data node
+        const uint8_t *node = root;
+
+        while (1)
+        {
+            if (bit_count == 0)
+            {
+                // The bitstream is stored in 32-bit units, starting from the
+                // most significant bit.
+                bits = src[0] | (src[1] << 8) | (src[2] << 16)
+                     | ((uint32_t)src[3] << 24);
+                src += 4;
+                bit_count = 32;
+            }
+
+            uint32_t bit = bits >> 31;
+            bits <<= 1;
+            bit_count--;
+
+            uint32_t n = *node;
+            const uint8_t *child = (const uint8_t *)
+                (((uintptr_t)node & ~(uintptr_t)1) + ((n & 0x3F) << 1) + 2 + bit);
+
+            node = child;
+
+            if (n & (0x80 >> bit))
+                break;
+        }
+
+        word |= (uint32_t)*node << out_bits;
+        out_bits += data_bits;
+
+        if (out_bits == 32)
+        {
+            dst[pos >> 2] = word;
+            pos += 4;
+            word = 0;
+            out_bits = 0;
+        }
+    }
+
+    state->src = src;
+    state->pos = pos;
+    state->pending = word;
+    state->out_bits = out_bits;
+    state->bits = bits;
+    state->bit_count = bit_count;
+}
+
+bool decompressIncrementalInit(DecompressIncremental *state, const void *data,
+                               void *dst, DecompressType type)
+{
+    const uint8_t *src = data;
+    uint32_t header = src[0] | (src[1] << 8) | (src[2] << 16)
+                    | ((uint32_t)src[3] << 24);
+    uint32_t format = header & 0xFF;
+
+    switch (type)
+    {
+        case LZ77:
+        case LZ77Vram:
+            if ((format != 0x10) && (format != 0x11))
+                return false;
+            break;
+        case RLE:
+        case RLEVram:
+            if (format != 0x30)
+                return false;
+            break;
+        case HUFF:
+            if ((format != 0x24) && (format != 0x28))
+                return false;
+            break;
+        default:
+            return false;
+    }
+
+    state->src = src + 4;
+    state->dst = dst;
+    state->size = header >> 8;
+    state->pos = 0;
+    state->type = type;
+    state->format = format;
+    state->flags = 0;
+    state->flag_count = 0;
+    state->run_len = 0;
+    state->run_arg = 0;
+    state->pending = 0;
+    state->last = 0;
+    state->tree = NULL;
+    state->bits = 0;
+    state->bit_count = 0;
+    state->out_bits = 0;
+
+    if (type == HUFF)
+    {
+        // The byte after the header is the size of the tree in halfwords minus
+        // one. The bitstream starts right after the tree.
+        state->tree = src + 5;
+        state->src = src + 4 + ((src[4] + 1) << 1);
+    }
+
+    return true;
+}
+
+size_t decompressIncrementalStep(DecompressIncremental *state,
+                                 size_t max_output_bytes)
+{
+    uint32_t start = state->pos;
+
+    if (start >= state->size)
+        return 0;
+
+    uint32_t end = state->size;
+    if (max_output_bytes < end - start)
+        end = start + max_output_bytes;
+
+    switch (state->type)
+    {
+        case LZ77:
+        case LZ77Vram:
+            decompress_incremental_lz77(state, end);
+            break;
+        case RLE:
+        case RLEVram:
+            decompress_incremental_rle(state, end);
+            break;
+        case HUFF:
+            decompress_incremental_huffman(state, end);
+            break;
+        default:
+            return 0;
+    }
+
+    if (state->pos >= state->size)
+        decompress_incremental_flush(state);
+
+    return state->pos - start;
+}
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#ifndef COMMON_DECOMPRESS_INTERNAL_H__
+#define COMMON_DECOMPRESS_INTERNAL_H__
+
+#include <stdint.h>
+
+// Software implementations of the decompression routines. They expect a source
+// buffer that starts with a GBA/NDS BIOS compression header.
+//
+// The "vram" versions only write to the destination in 16-bit units, and the
+// destination must be aligned to 16 bits.
+
+void decompress_lz77_wram(const void *src, void *dst);
+void decompress_lz77_vram(const void *src, void *dst);
+void decompress_lz4_wram(const void *src, void *dst);
+void decompress_lz4_vram(const void *src, void *dst);
+
+// The Huffman decoder needs a table of DECOMPRESS_HUFFMAN_TABLE_SIZE entries
+// provided by the caller. Its output is written in 32-bit units, so it can be
+// used with VRAM as destination.
+#define DECOMPRESS_HUFFMAN_TABLE_BITS   8
+#define DECOMPRESS_HUFFMAN_TABLE_SIZE   (1 << DECOMPRESS_HUFFMAN_TABLE_BITS)
+
+void decompress_huffman(const void *src, void *dst, uint32_t *table);
+
+// Helpers to write bytes to a destination that only supports 16-bit writes,
+// like VRAM. Bytes are accumulated in "pending" until there are two of them,
+// and they are written to the destination as one halfword. The last byte
+// written is kept in "last" because it may be pending when a reference uses it.
+// "base" must be a uint8_t pointer and "pos" the offset of the next byte.
+#define DECOMPRESS_VRAM_PUT(base, pos, pending, last, value)               \
+    do {                                                                    \
+        (last) = (value);                                                   \
+        if ((pos) & 1)                                                      \
+            *(uint16_t *)((base) + (pos) - 1) = (pending) | ((last) << 8);  \
+        else                                                                \
+            (pending) = (last);                                             \
+        (pos)++;                                                            \
+    } while (0)
+
+// If the size is odd, write the last byte and preserve the byte after it
+#define DECOMPRESS_VRAM_FLUSH(base, pos, pending)                           \
+    do {                                                                    \
+        if ((pos) & 1)                                                      \
+        {                                                                   \
+            *(uint16_t *)((base) + (pos) - 1) =                             \
+                (pending) | ((base)[(pos)] << 8);                           \
+        }                                                                   \
+    } while (0)
+
+#endif // COMMON_DECOMPRESS_INTERNAL_H__
@@ -0,0 +1,190 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <nds/ndstypes.h>
+
+#include "decompress_internal.h"
+
+// LZ4 decoders. The data starts with a header like the one of the BIOS
+// compression formats (type 0x40, size in the top 24 bits) followed by a LZ4
+// block, as generated by the reference LZ4 block compressor.
+//
+// A block is a list of sequences. Each sequence starts with a token byte:
+//
+//   LLLLMMMM
+//
+// If L is 15, bytes are added to it until one of them isn't 255. Then, the
+// literals are stored. After them, there is a 16-bit little endian offset, and
+// M is extended like L. The length of the match is M + 4. The last sequence
+// only has literals.
+//
+// All lengths are byte-aligned, so decoding this format is a lot faster than
+// decoding LZ77, which needs to check one flag for each byte or reference.
+
+// Reads the extra bytes of a length if needed.
+__attribute__((always_inline))
+static inline uint32_t decompress_lz4_length(const uint8_t **src, uint32_t len)
+{
+    if (len == 15)
+    {
+        const uint8_t *in = *src;
+        uint32_t value;
+        do
+        {
+            value = *in++;
+            len += value;
+        }
+        while (value == 255);
+        *src = in;
+    }
+
+    return len;
+}
+
+#ifdef ARM9
+ITCM_CODE
+#endif
+ARM_CODE
+void decompress_lz4_wram(const void *src, void *dst)
+{
+    uint32_t header = *(const uint32_t *)src;
+
+    const uint8_t *in = (const uint8_t *)src + 4;
+    uint8_t *out = dst;
+    uint8_t *end = out + (header >> 8);
+
+    while (out < end)
+    {
+        uint32_t token = *in++;
+
+        uint32_t len = decompress_lz4_length(&in, token >> 4);
+        if (len > (uint32_t)(end - out))
+            len = end - out;
+
+        memcpy(out, in, len);
+        out += len;
+        in += len;
+
+        if (out >= end)
+            break;
+
+        uint32_t offset = in[0] | (in[1] << 8);
+        in += 2;
+
+        len = decompress_lz4_length(&in, token & 0xF) + 4;
+        if (len > (uint32_t)(end - out))
+            len = end - out;
+
+        const uint8_t *copy = out - offset;
+
+        if (offset >= len)
+        {
+            // The source and destination don't overlap
+            memcpy(out, copy, len);
+            out += len;
+        }
+        else
+        {
+            do
+            {
+                *out++ = *copy++;
+            }
+            while (--len);
+        }
+    }
+}
+
+#ifdef ARM9
+ITCM_CODE
+#endif
+ARM_CODE
+void decompress_lz4_vram(const void *src, void *dst)
+{
+    uint32_t header = *(const uint32_t *)src;
+    uint32_t size = header >> 8;
+
+    const uint8_t *in = (const uint8_t *)src + 4;
+    uint8_t *base = dst;
+    uint32_t pos = 0;
+
+    // Bytes are written in pairs with DECOMPRESS_VRAM_PUT()
+    uint32_t pending = 0;
+    uint32_t last = 0;
+
+#define LZ4_VRAM_PUT(value) \
+    DECOMPRESS_VRAM_PUT(base, pos, pending, last, value)
+
+    while (pos < size)
+    {
+        uint32_t token = *in++;
+
+        uint32_t len = decompress_lz4_length(&in, token >> 4);
+        if (len > size - pos)
+            len = size - pos;
+
+        // Align the destination to copy pairs of literals directly
+        if ((pos & 1) && (len > 0))
+        {
+            LZ4_VRAM_PUT(*in++);
+            len--;
+        }
+
+        if (len >= 2)
+        {
+            uint16_t *out16 = (uint16_t *)(base + pos);
+            uint32_t pairs = len >> 1;
+
+            for (uint32_t i = 0; i < pairs; i++)
+            {
+                *out16++ = in[0] | (in[1] << 8);
+                in += 2;
+            }
+
+            pos += pairs << 1;
+            len -= pairs << 1;
+            last = in[-1];
+        }
+
+        while (len--)
+            LZ4_VRAM_PUT(*in++);
+
+        if (pos >= size)
+            break;
+
+        uint32_t offset = in[0] | (in[1] << 8);
+        in += 2;
+
+        len = decompress_lz4_length(&in, token & 0xF) + 4;
+        if (len > size - pos)
+            len = size - pos;
+
+        if (offset == 1)
+        {
+            // The byte that is repeated may not have been written yet
+            uint32_t value = last;
+            do
+            {
+                LZ4_VRAM_PUT(value);
+            }
+            while (--len);
+        }
+        else
+        {
+            const uint8_t *copy = base + pos - offset;
+            do
+            {
+                LZ4_VRAM_PUT(*copy++);
+            }
+            while (--len);
+        }
+    }
+
+#undef LZ4_VRAM_PUT
+
+    DECOMPRESS_VRAM_FLUSH(base, pos, pending);
+}
@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <nds/ndstypes.h>
+
+#include "decompress_internal.h"
+
+// Software LZ77 decoders. They support the format used by the BIOS (type 0x10)
+// and the extended format with longer matches (type 0x11), which isn't
+// supported by the BIOS.
+//
+// Each block of data starts with a byte with 8 flags, starting from the most
+// significant bit. If the flag is 0, the next byte is copied to the output. If
+// it is 1, the next bytes are a reference to previous output:
+//
+// Type 0x10:
+//
+//   LLLLDDDD DDDDDDDD
+//       length = L + 3, displacement = D + 1
+//
+// Type 0x11:
+//
+//   0000LLLL LLLLDDDD DDDDDDDD
+//       length = L + 0x11, displacement = D + 1
+//   0001LLLL LLLLLLLL LLLLDDDD DDDDDDDD
+//       length = L + 0x111, displacement = D + 1
+//   LLLLDDDD DDDDDDDD (LLLL > 1)
+//       length = L + 1, displacement = D + 1
+//
+// The BIOS routines call a function for every byte they read, and they run
+// from the BIOS, which can't be cached. These routines are placed in ITCM in
+// the ARM9, and they are built as ARM code to make them as fast as possible.
+
+// Reads a back-reference and returns its length. The displacement is returned
+// in "disp", and the source pointer is advanced.
+__attribute__((always_inline))
+static inline uint32_t decompress_lz77_reference(const uint8_t **src,
+                                                 uint32_t *disp, bool lz11)
+{
+    const uint8_t *in = *src;
+    uint32_t b0 = *in++;
+    uint32_t len;
+
+    if (lz11)
+    {
+        uint32_t indicator = b0 >> 4;
+
+        if (indicator == 0)
+        {
+            uint32_t b1 = *in++;
+            uint32_t b2 = *in++;
+            len = ((b0 << 4) | (b1 >> 4)) + 0x11;
+            *disp = (((b1 & 0xF) << 8) | b2) + 1;
+        }
+        else if (indicator == 1)
+        {
+            uint32_t b1 = *in++;
+            uint32_t b2 = *in++;
+            uint32_t b3 = *in++;
+            len = (((b0 & 0xF) << 12) | (b1 << 4) | (b2 >> 4)) + 0x111;
+            *disp = (((b2 & 0xF) << 8) | b3) + 1;
+        }
+        else
+        {
+            uint32_t b1 = *in++;
+            len = indicator + 1;
+            *disp = (((b0 & 0xF) << 8) | b1) + 1;
+        }
+    }
+    else
+    {
+        uint32_t b1 = *in++;
+        len = (b0 >> 4) + 3;
+        *disp = (((b0 & 0xF) << 8) | b1) + 1;
+    }
+
+    *src = in;
+    return len;
+}
+
+#ifdef ARM9
+ITCM_CODE
+#endif
+ARM_CODE
+void decompress_lz77_wram(const void *src, void *dst)
+{
+    uint32_t header = *(const uint32_t *)src;
+    bool lz11 = (header & 0xFF) == 0x11;
+
+    const uint8_t *in = (const uint8_t *)src + 4;
+    uint8_t *out = dst;
+    uint8_t *end = out + (header >> 8);
+
+    while (out < end)
+    {
+        uint32_t flags = *in++;
+
+        // Fast path for blocks of 8 literals
+        if ((flags == 0) && ((end - out) >= 8))
+        {
+            for (int i = 0; i < 8; i++)
+                *out++ = *in++;
+            continue;
+        }
+
+        for (uint32_t mask = 0x80; mask != 0; mask >>= 1)
+        {
+            if (flags & mask)
+            {
+                uint32_t disp;
+                uint32_t len = decompress_lz77_reference(&in, &disp, lz11);
+
+                // The BIOS stops as soon as the output is full.
+                if (len > (uint32_t)(end - out))
+                    len = end - out;
+
+                const uint8_t *copy = out - disp;
+                do
+                {
+                    *out++ = *copy++;
+                }
+                while (--len);
+            }
+            else
+            {
+                *out++ = *in++;
+            }
+
+            if (out >= end)
+                return;
+        }
+    }
+}
+
+#ifdef ARM9
+ITCM_CODE
+#endif
+ARM_CODE
+void decompress_lz77_vram(const void *src, void *dst)
+{
+    uint32_t header = *(const uint32_t *)src;
+    bool lz11 = (header & 0xFF) == 0x11;
+    uint32_t size = header >> 8;
+
+    const uint8_t *in = (const uint8_t *)src + 4;
+    uint8_t *base = dst;
+    uint32_t pos = 0;
+
+    // Bytes are written in pairs with DECOMPRESS_VRAM_PUT()
+    uint32_t pending = 0;
+    uint32_t last = 0;
+
+#define LZ77_VRAM_PUT(value) \
+    DECOMPRESS_VRAM_PUT(base, pos, pending, last, value)
+
+    while (pos < size)
+    {
+        uint32_t flags = *in++;
+
+        for (uint32_t mask = 0x80; mask != 0; mask >>= 1)
+        {
+            if (flags & mask)
+            {
+                uint32_t disp;
+                uint32_t len = decompress_lz77_reference(&in, &disp, lz11);
+
+                if (len > size - pos)
+                    len = size - pos;
+
+                if (disp == 1)
+                {
+                    // The byte that is repeated may not have been written yet
+                    uint32_t value = last;
+                    do
+                    {
+                        LZ77_VRAM_PUT(value);
+                    }
+                    while (--len);
+                }
+                else
+                {
+                    // With a displacement of 2 or more, the source bytes have
+                    // always been written to the destination already. 8-bit
+                    // reads from VRAM are allowed.
+                    const uint8_t *copy = base + pos - disp;
+                    do
+                    {
+                        LZ77_VRAM_PUT(*copy++);
+                    }
+                    while (--len);
+                }
+            }
+            else
+            {
+                LZ77_VRAM_PUT(*in++);
+            }
+
+            if (pos >= size)
+                break;
+        }
+    }
+
+#undef LZ77_VRAM_PUT
+
+    DECOMPRESS_VRAM_FLUSH(base, pos, pending);
+}
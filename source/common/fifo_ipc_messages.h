@@ -9,6 +9,7 @@
 
 #include <stdbool.h>
 
+#include <nds/fifocommon.h>
 #include <nds/ndstypes.h>
 
 // Defines related to the header block of a FIFO message
@@ -17,7 +18,9 @@
 // Number of bits used to specify the channel of a packet
 #define FIFO_CHANNEL_BITS       4
 
-#define FIFO_NUM_CHANNELS       (1 << FIFO_CHANNEL_BITS)
+_Static_assert(FIFO_NUM_CHANNELS == (1 << FIFO_CHANNEL_BITS),
+               "FIFO_NUM_CHANNELS doesn't match FIFO_CHANNEL_BITS");
+
 #define FIFO_CHANNEL_SHIFT      (32 - FIFO_CHANNEL_BITS)
 #define FIFO_CHANNEL_MASK       ((1 << FIFO_CHANNEL_BITS) - 1)
 
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <string.h>
+
+#include <nds/fifocommon.h>
+#include <nds/fiforing.h>
+#include <nds/system.h>
+
+#ifdef ARM9
+#include <nds/arm9/cache.h>
+#include <nds/arm9/cp15.h>
+#endif
+
+#include "fifo_ipc_messages.h"
+
+// The indices of the ring are never wrapped. They count the total number of
+// bytes written and read, so the number of bytes in the ring is always
+// "write_index - read_index", even when the 32-bit counters overflow. The size
+// of the buffer is a power of two so that the counters can be converted to
+// offsets with a mask.
+//
+// In the ARM9 all accesses to the ring use the uncached mirror of main RAM, so
+// there is no need to manage the data cache.
+
+FifoRing *fifoRingInit(void *memory, size_t memory_size, u32 channel,
+                       u32 doorbell)
+{
+    if (memory == NULL)
+        return NULL;
+
+    if ((channel >= FIFO_NUM_CHANNELS) && (channel != FIFO_RING_NO_DOORBELL))
+        return NULL;
+
+    if (((uintptr_t)memory & 31) != 0)
+        return NULL;
+
+    if (!fifo_ipc_is_address_compatible(memory))
+        return NULL;
+
+    if (memory_size <= sizeof(FifoRing))
+        return NULL;
+
+    size_t max_size = memory_size - sizeof(FifoRing);
+    size_t size = 1;
+    while ((size << 1) <= max_size)
+        size <<= 1;
+
+#ifdef ARM9
+    DC_FlushRange(memory, sizeof(FifoRing) + size);
+    FifoRing *ring = memUncached(memory);
+#else
+    FifoRing *ring = memory;
+#endif
+
+    ring->write_index = 0;
+    ring->read_index = 0;
+    ring->size = size;
+    ring->channel = channel;
+    ring->doorbell = doorbell;
+
+    return ring;
+}
+
+bool fifoRingSendAddress(u32 channel, FifoRing *ring)
+{
+#ifdef ARM9
+    // The other CPU doesn't have a cache, it can use the regular address
+    return fifoSendAddress(channel, memCached(ring));
+#else
+    return fifoSendAddress(channel, ring);
+#endif
+}
+
+FifoRing *fifoRingAttach(void *address)
+{
+    if (address == NULL)
+        return NULL;
+
+#ifdef ARM9
+    return memUncached(address);
+#else
+    return address;
+#endif
+}
+
+bool fifoRingWrite(FifoRing *ring, const void *data, size_t size)
+{
+    u32 write_index = ring->write_index;
+    u32 read_index = ring->read_index;
+
+    if (size > ring->size - (write_index - read_index))
+        return false;
+
+    if (size == 0)
+        return true;
+
+    u32 mask = ring->size - 1;
+    u32 offset = write_index & mask;
+    u32 first = ring->size - offset;
+    if (first > size)
+        first = size;
+
+    memcpy(&ring->data[offset], data, first);
+    memcpy(&ring->data[0], (const u8 *)data + first, size - first);
+
+    // Publish the data before checking if the consumer needs the doorbell.
+    ring->write_index = write_index + size;
+#ifdef ARM9
+    CP15_DrainWriteBuffer();
+#endif
+
+    // If the consumer had read everything that had been written before this
+    // call, it may be waiting for the doorbell. If it hadn't, it will see the
+    // new write index when it finishes reading the old data.
+    if ((ring->read_index == write_index) &&
+        (ring->channel != FIFO_RING_NO_DOORBELL))
+        fifoSendValue32(ring->channel, ring->doorbell);
+
+    return true;
+}
+
+size_t fifoRingRead(FifoRing *ring, void *data, size_t size)
+{
+    u32 read_index = ring->read_index;
+    u32 available = ring->write_index - read_index;
+
+    if (size > available)
+        size = available;
+
+    if (size == 0)
+        return 0;
+
+    u32 mask = ring->size - 1;
+    u32 offset = read_index & mask;
+    u32 first = ring->size - offset;
+    if (first > size)
+        first = size;
+
+    memcpy(data, &ring->data[offset], first);
+    memcpy((u8 *)data + first, &ring->data[0], size - first);
+
+    // Release the space after the data has been copied
+    ring->read_index = read_index + size;
+#ifdef ARM9
+    CP15_DrainWriteBuffer();
+#endif
+
+    return size;
+}
@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#include <string.h>
+
+#include <nds/bios.h>
+#include <nds/cothread.h>
+#include <nds/fifocommon.h>
+#include <nds/fiforpc.h>
+#include <nds/interrupts.h>
+#include <nds/timers.h>
+
+#include "fifo_ipc_messages.h"
+#include "common/libnds_internal.h"
+
+// Requests and answers are data messages that start with a 32-bit header:
+//
+//   Bit 31:    1 for answers, 0 for requests
+//   Bits 0-15: ID of the request
+//
+// The ID is formed by the index of the request in the table of pending requests
+// of the sender (the low 5 bits) and a counter that is incremented every time a
+// request is sent (the upper bits). The counter makes it possible to detect
+// answers to old requests that have been reused.
+
+#define FIFO_RPC_REPLY_BIT      BIT(31)
+#define FIFO_RPC_ID_MASK        0xFFFF
+
+#define FIFO_RPC_SLOT_BITS      5
+#define FIFO_RPC_SLOT_MASK      ((1 << FIFO_RPC_SLOT_BITS) - 1)
+
+_Static_assert(FIFO_RPC_MAX_PENDING == (1 << FIFO_RPC_SLOT_BITS),
+               "Wrong number of pending requests");
+
+// Requests sent by this CPU that are waiting for their answer
+static FifoRpcRequest *fifo_rpc_pending[FIFO_RPC_MAX_PENDING];
+static u32 fifo_rpc_counter;
+
+static FifoRpcHandlerFunc fifo_rpc_handler[FIFO_NUM_CHANNELS];
+static void *fifo_rpc_userdata[FIFO_NUM_CHANNELS];
+
+static void fifo_rpc_complete(u32 id, const void *data, size_t size)
+{
+    u32 slot = id & FIFO_RPC_SLOT_MASK;
+
+    FifoRpcRequest *req = fifo_rpc_pending[slot];
+
+    // Ignore answers to requests that don't exist
+    if ((req == NULL) || (req->id != id))
+        return;
+
+    fifo_rpc_pending[slot] = NULL;
+
+    if (size > req->response_size)
+        size = req->response_size;
+
+    if (size > 0)
+        memcpy(req->response, data, size);
+
+    req->response_size = size;
+    req->done = 1;
+
+#ifdef FIFO_ENABLE_STATS
+    fifo_stats_rpc_latency(cpuGetTiming() - req->start_time);
+#endif
+}
+
+static void fifo_rpc_datamsg_handler(int num_bytes, void *userdata)
+{
+    u32 channel = (uintptr_t)userdata;
+
+    u32 buffer[(FIFO_RPC_MAX_DATA_BYTES + 4) / 4];
+
+    if ((num_bytes < 4) || (num_bytes > (int)sizeof(buffer)))
+        return; // Let the FIFO system delete the message
+
+    fifoGetDatamsg(channel, num_bytes, (u8 *)buffer);
+
+    u32 header = buffer[0];
+    u32 id = header & FIFO_RPC_ID_MASK;
+    size_t size = num_bytes - 4;
+
+    if (header & FIFO_RPC_REPLY_BIT)
+    {
+        fifo_rpc_complete(id, &buffer[1], size);
+    }
+    else
+    {
+        FifoRpcHandlerFunc handler = fifo_rpc_handler[channel];
+
+        if (handler != NULL)
+            handler(channel, id, &buffer[1], size, fifo_rpc_userdata[channel]);
+        else
+            fifoRpcReply(channel, id, NULL, 0);
+    }
+}
+
+bool fifoRpcInit(u32 channel, FifoRpcHandlerFunc handler, void *userdata)
+{
+    if (channel >= FIFO_NUM_CHANNELS)
+        return false;
+
+    int oldIME = enterCriticalSection();
+
+    fifo_rpc_handler[channel] = handler;
+    fifo_rpc_userdata[channel] = userdata;
+
+    leaveCriticalSection(oldIME);
+
+    return fifoSetDatamsgHandler(channel, fifo_rpc_datamsg_handler,
+                                 (void *)(uintptr_t)channel);
+}
+
+static bool fifo_rpc_send(u32 channel, u32 header, const void *data,
+                          size_t size)
+{
+    if (size > FIFO_RPC_MAX_DATA_BYTES)
+        return false;
+
+    if ((size > 0) && (data == NULL))
+        return false;
+
+    u32 buffer[(FIFO_RPC_MAX_DATA_BYTES + 4) / 4];
+
+    buffer[0] = header;
+    if (size > 0)
+        memcpy(&buffer[1], data, size);
+
+    return fifoSendDatamsg(channel, size + 4, (u8 *)buffer);
+}
+
+bool fifoRpcSend(u32 channel, const void *data, size_t size,
+                 FifoRpcRequest *req, void *response, size_t response_size)
+{
+    if ((channel >= FIFO_NUM_CHANNELS) || (req == NULL))
+        return false;
+
+    if (response == NULL)
+        response_size = 0;
+
+    req->done = 0;
+    req->response = response;
+    req->response_size = response_size;
+#ifdef FIFO_ENABLE_STATS
+    req->start_time = cpuGetTiming();
+#endif
+
+    int oldIME = enterCriticalSection();
+
+    // Look for a free slot in the table of pending requests
+    u32 slot = 0;
+    while ((slot < FIFO_RPC_MAX_PENDING) && (fifo_rpc_pending[slot] != NULL))
+        slot++;
+
+    if (slot == FIFO_RPC_MAX_PENDING)
+    {
+        leaveCriticalSection(oldIME);
+        return false;
+    }
+
+    fifo_rpc_counter++;
+    req->id = ((fifo_rpc_counter << FIFO_RPC_SLOT_BITS) | slot)
+              & FIFO_RPC_ID_MASK;
+
+    fifo_rpc_pending[slot] = req;
+
+    // The request is added to the table before sending it so that the answer
+    // can always find it.
+    bool ret = fifo_rpc_send(channel, req->id, data, size);
+    if (!ret)
+        fifo_rpc_pending[slot] = NULL;
+
+    leaveCriticalSection(oldIME);
+
+    return ret;
+}
+
+bool fifoRpcReply(u32 channel, u32 id, const void *data, size_t size)
+{
+    if (channel >= FIFO_NUM_CHANNELS)
+        return false;
+
+    return fifo_rpc_send(channel, FIFO_RPC_REPLY_BIT | (id & FIFO_RPC_ID_MASK),
+                         data, size);
+}
+
+size_t fifoRpcWait(FifoRpcRequest *req)
+{
+    while (!req->done)
+    {
+#ifdef ARM9
+        cothread_yield_irq(IRQ_FIFO_NOT_EMPTY);
+#else
+        swiIntrWait(1, IRQ_FIFO_NOT_EMPTY);
+#endif
+    }
+
+    return req->response_size;
+}
+
+int fifoRpcCall(u32 channel, const void *data, size_t size, void *response,
+                size_t response_size)
+{
+    FifoRpcRequest req;
+
+    if (!fifoRpcSend(channel, data, size, &req, response, response_size))
+        return -1;
+
+    return fifoRpcWait(&req);
+}
@@ -13,26 +13,33 @@
 #include <nds/interrupts.h>
 #include <nds/ipc.h>
 #include <nds/system.h>
+#include <nds/timers.h>
 
 #include "fifo_ipc_messages.h"
+#include "common/libnds_internal.h"
+
+// Statistics that can be read with fifoGetStats() are only collected if
+// FIFO_ENABLE_STATS is defined. Build libnds with "make FIFO_STATS=1" for that.
+#ifdef FIFO_ENABLE_STATS
+static FifoStats fifo_stats;
+#define FIFO_STATS_ADD(field, value)    do { fifo_stats.field += (value); } while (0)
+#else
+#define FIFO_STATS_ADD(field, value)    do { } while (0)
+#endif
 
 // Maximum number of bytes that can be sent in a fifo message
 #define FIFO_MAX_DATA_BYTES     128
 
-// Number of words that can be stored temporarily while waiting to deque them
-#ifdef ARM9
-#define FIFO_BUFFER_ENTRIES     256
-#else // ARM7
-#define FIFO_BUFFER_ENTRIES     256
-#endif
-
 // The memory overhead of this library (per CPU) is:
 //
-//     16 + (NUM_CHANNELS * 32) + (FIFO_BUFFER_ENTRIES * 8)
+//     16 + (NUM_CHANNELS * 32) + (fifo_buffer_entries * 8)
 //
 // For 16 channels and 256 entries, this is 16 + 512 + 2048 = 2576 bytes of ram.
 //
 // Some padding may be added by the compiler, though.
+//
+// The buffer of FIFO_BUFFER_DEFAULT_ENTRIES words is only used by fifoInit().
+// Applications that call fifoInitWithBuffer() instead don't need to link it.
 
 // In the fifo_buffer[] array, this value means that there are no more values
 // left to handle.
@@ -52,8 +59,14 @@
 // - Next: Index of next block in the list. If "Next == FIFO_BUFFER_TERMINATE"
 //   it means that is the end of the list.
 
-// FIFO_BUFFER_ENTRIES * 8 bytes of global buffer space
-static vu32 fifo_buffer[FIFO_BUFFER_ENTRIES * 2];
+// fifo_buffer_entries * 8 bytes of global buffer space
+static vu32 *fifo_buffer;
+static u32 fifo_buffer_entries;
+
+#ifdef ARM9
+// True if fifo_buffer has been allocated by fifoGrowBuffer()
+static bool fifo_buffer_in_heap;
+#endif
 
 #define FIFO_BUFFERCONTROL_UNUSED       0
 #define FIFO_BUFFERCONTROL_DATASTART    5
@@ -96,11 +109,11 @@ static fifo_queue fifo_address_queue[FIFO_NUM_CHANNELS];
 static fifo_queue fifo_data_queue[FIFO_NUM_CHANNELS];
 static fifo_queue fifo_value32_queue[FIFO_NUM_CHANNELS];
 
-static fifo_queue fifo_buffer_free = {0, FIFO_BUFFER_ENTRIES - 1};
-static fifo_queue fifo_send_queue = {FIFO_BUFFER_TERMINATE, FIFO_BUFFER_TERMINATE};
-static fifo_queue fifo_receive_queue = {FIFO_BUFFER_TERMINATE, FIFO_BUFFER_TERMINATE};
+static fifo_queue fifo_buffer_free;
+static fifo_queue fifo_send_queue;
+static fifo_queue fifo_receive_queue;
 
-static vu32 fifo_freewords = FIFO_BUFFER_ENTRIES;
+static vu32 fifo_freewords;
 
 // Try to allocate a new block. If it fails, it returns FIFO_BUFFER_TERMINATE.
 // If not, it returns the index of the block it has just allocated.
@@ -113,6 +126,13 @@ static u32 fifo_buffer_alloc_block(void)
     fifo_buffer_free.head = FIFO_BUFFER_GETNEXT(fifo_buffer_free.head);
     FIFO_BUFFER_SETCONTROL(entry, FIFO_BUFFER_TERMINATE, FIFO_BUFFERCONTROL_UNUSED, 0);
     fifo_freewords--;
+
+#ifdef FIFO_ENABLE_STATS
+    u32 used = fifo_buffer_entries - fifo_freewords;
+    if (used > fifo_stats.buffer_high_water)
+        fifo_stats.buffer_high_water = used;
+#endif
+
     return entry;
 }
 
@@ -121,12 +141,25 @@ static u32 fifo_buffer_wait_block(void)
 {
     u32 block;
 
+#ifdef FIFO_ENABLE_STATS
+    bool blocked = false;
+    u32 start = 0;
+#endif
+
     do
     {
         block = fifo_buffer_alloc_block();
 
         if (block == FIFO_BUFFER_TERMINATE)
         {
+#ifdef FIFO_ENABLE_STATS
+            if (!blocked)
+            {
+                blocked = true;
+                start = cpuGetTiming();
+                fifo_stats.send_blocked_count++;
+            }
+#endif
             REG_IPC_FIFO_CR |= IPC_FIFO_SEND_IRQ;
             REG_IME = 1;
             swiIntrWait(0, IRQ_FIFO_EMPTY);
@@ -134,6 +167,11 @@ static u32 fifo_buffer_wait_block(void)
         }
     } while (block == FIFO_BUFFER_TERMINATE);
 
+#ifdef FIFO_ENABLE_STATS
+    if (blocked)
+        fifo_stats.send_blocked_ticks += cpuGetTiming() - start;
+#endif
+
     return block;
 }
 
@@ -141,7 +179,13 @@ static u32 fifo_buffer_wait_block(void)
 static void fifo_buffer_free_block(u32 index)
 {
     FIFO_BUFFER_SETCONTROL(index, FIFO_BUFFER_TERMINATE, FIFO_BUFFERCONTROL_UNUSED, 0);
-    FIFO_BUFFER_SETCONTROL(fifo_buffer_free.tail, index, FIFO_BUFFERCONTROL_UNUSED, 0);
+
+    // If the list is empty, the tail points to a block that is in use
+    if (fifo_freewords == 0)
+        fifo_buffer_free.head = index;
+    else
+        FIFO_BUFFER_SETCONTROL(fifo_buffer_free.tail, index, FIFO_BUFFERCONTROL_UNUSED, 0);
+
     fifo_buffer_free.tail = index;
     fifo_freewords++;
 }
@@ -263,7 +307,10 @@ static bool fifoInternalSend(u32 firstword, u32 extrawordcount, u32 *wordlist)
         return false;
 
     if (fifo_freewords < extrawordcount + 1)
+    {
+        FIFO_STATS_ADD(send_failed_count, 1);
         return false;
+    }
 
     if (extrawordcount > (FIFO_MAX_DATA_BYTES / 4))
         return false;
@@ -322,7 +369,13 @@ bool fifoSendAddress(u32 channel, void *address)
     if (!fifo_ipc_is_address_compatible(address))
         return false;
 
-    return fifoInternalSend(fifo_ipc_pack_address(channel, address), 0, 0);
+    if (!fifoInternalSend(fifo_ipc_pack_address(channel, address), 0, 0))
+        return false;
+
+    FIFO_STATS_ADD(address[channel].messages_sent, 1);
+    FIFO_STATS_ADD(address[channel].bytes_sent, 4);
+
+    return true;
 }
 
 bool fifoSendValue32(u32 channel, u32 value32)
@@ -331,20 +384,29 @@ bool fifoSendValue32(u32 channel, u32 value32)
         return false;
 
     u32 send_first, send_extra[1];
+    bool ret;
 
     if (fifo_ipc_value32_needextra(value32))
     {
         // The value doesn't fit in just one 32-bit message
         send_first = fifo_ipc_pack_value32_extra(channel);
         send_extra[0] = value32;
-        return fifoInternalSend(send_first, 1, send_extra);
+        ret = fifoInternalSend(send_first, 1, send_extra);
     }
     else
     {
         // The value fits in a 32-bit message
         send_first = fifo_ipc_pack_value32(channel, value32);
-        return fifoInternalSend(send_first, 0, 0);
+        ret = fifoInternalSend(send_first, 0, 0);
     }
+
+    if (ret)
+    {
+        FIFO_STATS_ADD(value32[channel].messages_sent, 1);
+        FIFO_STATS_ADD(value32[channel].bytes_sent, 4);
+    }
+
+    return ret;
 }
 
 bool fifoSendDatamsg(u32 channel, u32 num_bytes, u8 *data_array)
@@ -355,7 +417,11 @@ bool fifoSendDatamsg(u32 channel, u32 num_bytes, u8 *data_array)
     if (num_bytes == 0)
     {
         u32 send_first = fifo_ipc_pack_datamsg_header(channel, 0);
-        return fifoInternalSend(send_first, 0, NULL);
+        if (!fifoInternalSend(send_first, 0, NULL))
+            return false;
+
+        FIFO_STATS_ADD(datamsg[channel].messages_sent, 1);
+        return true;
     }
 
     if (data_array == NULL)
@@ -374,7 +440,13 @@ bool fifoSendDatamsg(u32 channel, u32 num_bytes, u8 *data_array)
     buffer_array[num_words - 1] = 0; // Clear the last few bytes before the copy
     memcpy(buffer_array, data_array, num_bytes);
     u32 send_first = fifo_ipc_pack_datamsg_header(channel, num_bytes);
-    return fifoInternalSend(send_first, num_words, buffer_array);
+    if (!fifoInternalSend(send_first, num_words, buffer_array))
+        return false;
+
+    FIFO_STATS_ADD(datamsg[channel].messages_sent, 1);
+    FIFO_STATS_ADD(datamsg[channel].bytes_sent, num_bytes);
+
+    return true;
 }
 
 void *fifoGetAddress(u32 channel)
@@ -564,6 +636,9 @@ static void fifoInternalRecvInterrupt(void)
         {
             void *address = fifo_ipc_unpack_address(data);
 
+            FIFO_STATS_ADD(address[channel].messages_received, 1);
+            FIFO_STATS_ADD(address[channel].bytes_received, 4);
+
             fifo_receive_queue.head = FIFO_BUFFER_GETNEXT(block);
             if (fifo_address_func[channel])
             {
@@ -599,6 +674,9 @@ static void fifoInternalRecvInterrupt(void)
                 value32 = fifo_ipc_unpack_value32_noextra(data);
             }
 
+            FIFO_STATS_ADD(value32[channel].messages_received, 1);
+            FIFO_STATS_ADD(value32[channel].bytes_received, 4);
+
             // Increase read pointer
             fifo_receive_queue.head = FIFO_BUFFER_GETNEXT(block);
 
@@ -636,6 +714,9 @@ static void fifoInternalRecvInterrupt(void)
 
             fifo_receive_queue.head = FIFO_BUFFER_GETNEXT(end);
 
+            FIFO_STATS_ADD(datamsg[channel].messages_received, 1);
+            FIFO_STATS_ADD(datamsg[channel].bytes_received, n_bytes);
+
             // Add messages from the FIFO buffer to the receive queue.
             int tmp = FIFO_BUFFER_GETNEXT(block);
             fifo_buffer_free_block(block);
@@ -701,8 +782,14 @@ static void fifoInternalSendInterrupt(void)
     }
 }
 
-bool fifoInit(void)
+bool fifoInitWithBuffer(void *buffer, u32 entries)
 {
+    if ((buffer == NULL) || (((uintptr_t)buffer & 3) != 0))
+        return false;
+
+    if ((entries < FIFO_BUFFER_MIN_ENTRIES) || (entries > FIFO_BUFFER_MAX_ENTRIES))
+        return false;
+
     // Clear all the words that were being sent to the other CPU
     REG_IPC_FIFO_CR = IPC_FIFO_SEND_CLEAR;
 
@@ -723,15 +810,34 @@ bool fifoInit(void)
         fifo_datamsg_func[i] = 0;
     }
 
-    for (int i = 0; i < FIFO_BUFFER_ENTRIES - 1; i++)
+#ifdef ARM9
+    if (fifo_buffer_in_heap)
+        free((void *)fifo_buffer);
+    fifo_buffer_in_heap = false;
+#endif
+
+    fifo_buffer = buffer;
+    fifo_buffer_entries = entries;
+
+    for (u32 i = 0; i < entries - 1; i++)
     {
         FIFO_BUFFER_DATA(i) = 0;
         FIFO_BUFFER_SETCONTROL(i, i + 1, 0, 0);
     }
 
-    FIFO_BUFFER_SETCONTROL(FIFO_BUFFER_ENTRIES - 1, FIFO_BUFFER_TERMINATE,
+    FIFO_BUFFER_DATA(entries - 1) = 0;
+    FIFO_BUFFER_SETCONTROL(entries - 1, FIFO_BUFFER_TERMINATE,
                            FIFO_BUFFERCONTROL_UNUSED, 0);
 
+    fifo_buffer_free.head = 0;
+    fifo_buffer_free.tail = entries - 1;
+    fifo_freewords = entries;
+
+    fifo_send_queue.head = FIFO_BUFFER_TERMINATE;
+    fifo_send_queue.tail = FIFO_BUFFER_TERMINATE;
+    fifo_receive_queue.head = FIFO_BUFFER_TERMINATE;
+    fifo_receive_queue.tail = FIFO_BUFFER_TERMINATE;
+
     irqSet(IRQ_FIFO_EMPTY, fifoInternalSendInterrupt);
     irqSet(IRQ_FIFO_NOT_EMPTY, fifoInternalRecvInterrupt);
     REG_IPC_FIFO_CR = IPC_FIFO_ENABLE | IPC_FIFO_RECV_IRQ;
@@ -740,6 +846,114 @@ bool fifoInit(void)
     return true;
 }
 
+bool fifoInit(void)
+{
+    static u32 fifo_buffer_default[FIFO_BUFFER_DEFAULT_ENTRIES * 2];
+
+    return fifoInitWithBuffer(fifo_buffer_default, FIFO_BUFFER_DEFAULT_ENTRIES);
+}
+
+u32 fifoGetBufferEntries(void)
+{
+    return fifo_buffer_entries;
+}
+
+#ifdef ARM9
+
+bool fifoGrowBuffer(u32 entries)
+{
+    if (entries > FIFO_BUFFER_MAX_ENTRIES)
+        return false;
+
+    if (entries <= fifo_buffer_entries)
+        return true;
+
+    vu32 *new_buffer = malloc(FIFO_BUFFER_BYTES(entries));
+    if (new_buffer == NULL)
+        return false;
+
+    int oldIME = enterCriticalSection();
+
+    u32 old_entries = fifo_buffer_entries;
+    vu32 *old_buffer = fifo_buffer;
+    bool old_in_heap = fifo_buffer_in_heap;
+
+    // All the indices stored in the buffer and the queues are still valid
+    // after copying the current entries to the new buffer.
+    memcpy((void *)new_buffer, (const void *)old_buffer,
+           FIFO_BUFFER_BYTES(old_entries));
+
+    fifo_buffer = new_buffer;
+    fifo_buffer_entries = entries;
+    fifo_buffer_in_heap = true;
+
+    // Add the new entries to the list of free blocks
+    for (u32 i = old_entries; i < entries - 1; i++)
+    {
+        FIFO_BUFFER_DATA(i) = 0;
+        FIFO_BUFFER_SETCONTROL(i, i + 1, 0, 0);
+    }
+
+    FIFO_BUFFER_DATA(entries - 1) = 0;
+    FIFO_BUFFER_SETCONTROL(entries - 1, FIFO_BUFFER_TERMINATE,
+                           FIFO_BUFFERCONTROL_UNUSED, 0);
+
+    if (fifo_freewords == 0)
+        fifo_buffer_free.head = old_entries;
+    else
+        FIFO_BUFFER_SETNEXT(fifo_buffer_free.tail, old_entries);
+
+    fifo_buffer_free.tail = entries - 1;
+    fifo_freewords += entries - old_entries;
+
+    leaveCriticalSection(oldIME);
+
+    if (old_in_heap)
+        free((void *)old_buffer);
+
+    return true;
+}
+
+#endif // ARM9
+
+#ifdef FIFO_ENABLE_STATS
+void fifo_stats_rpc_latency(u32 ticks)
+{
+    fifo_stats.rpc_completed++;
+    fifo_stats.rpc_latency_total += ticks;
+    if (ticks > fifo_stats.rpc_latency_max)
+        fifo_stats.rpc_latency_max = ticks;
+}
+#endif
+
+bool fifoGetStats(FifoStats *stats)
+{
+    if (stats == NULL)
+        return false;
+
+#ifdef FIFO_ENABLE_STATS
+    int oldIME = enterCriticalSection();
+    *stats = fifo_stats;
+    leaveCriticalSection(oldIME);
+
+    stats->buffer_entries = fifo_buffer_entries;
+
+    return true;
+#else
+    memset(stats, 0, sizeof(FifoStats));
+    return false;
+#endif
+}
+
+void fifoResetStats(void)
+{
+#ifdef FIFO_ENABLE_STATS
+    int oldIME = enterCriticalSection();
+    memset(&fifo_stats, 0, sizeof(fifo_stats));
+    leaveCriticalSection(oldIME);
+#endif
+}
+
 #ifdef ARM9
 
 static comutex_t fifo_mutex[FIFO_NUM_CHANNELS];
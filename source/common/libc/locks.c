@@ -61,77 +61,54 @@ void __retarget_lock_close_recursive(_LOCK_T lock)
     libndsCrash("Lock close");
 }
 
+// The mutex is held by the thread that owns the lock for as long as it owns
+// it, so other threads that want the lock are blocked in the wait queue of the
+// mutex instead of polling it.
+
 void __retarget_lock_acquire_recursive(_LOCK_T lock)
 {
     void *this_thread = __aeabi_read_tp();
 
-    // Loop until this thread owns the lock, or no thread owns it
-    while (1)
+    if (lock->thread_owner != this_thread)
     {
-        bool acquired = false;
-
         comutex_acquire(&(lock->mutex));
-
-        if (lock->thread_owner == this_thread)
-        {
-            lock->recursion++;
-            acquired = true;
-        }
-        else if (lock->thread_owner == NULL)
-        {
-            lock->thread_owner = this_thread;
-            lock->recursion++;
-            acquired = true;
-        }
-
-        comutex_release(&(lock->mutex));
-
-        if (acquired)
-            break;
-
-        cothread_yield();
+        lock->thread_owner = this_thread;
     }
+
+    lock->recursion++;
 }
 
 int __retarget_lock_try_acquire_recursive(_LOCK_T lock)
 {
     void *this_thread = __aeabi_read_tp();
-    bool acquired = false;
-
-    comutex_acquire(&(lock->mutex));
 
-    if (lock->thread_owner == this_thread)
-    {
-        lock->recursion++;
-        acquired = true;
-    }
-    else if (lock->thread_owner == NULL)
+    if (lock->thread_owner != this_thread)
     {
+        if (!comutex_try_acquire(&(lock->mutex)))
+            return false;
+
         lock->thread_owner = this_thread;
-        lock->recursion++;
-        acquired = true;
     }
 
-    comutex_release(&(lock->mutex));
+    lock->recursion++;
 
-    return acquired;
+    return true;
 }
 
 void __retarget_lock_release_recursive(_LOCK_T lock)
 {
     void *this_thread = __aeabi_read_tp();
 
-    comutex_acquire(&(lock->mutex));
-
     if (lock->thread_owner != this_thread)
         libndsCrash("Lock release");
 
     lock->recursion--;
 
     if (lock->recursion == 0)
+    {
         lock->thread_owner = NULL;
-
-    comutex_release(&(lock->mutex));
+        comutex_release(&(lock->mutex));
+    }
 }
 
 void __retarget_lock_init(_LOCK_T *lock)
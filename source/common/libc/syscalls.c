@@ -9,6 +9,8 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <nds/cothread.h>
+
 #ifdef ARM9
 #include "arm9/libnds_internal.h"
 #endif
@@ -119,6 +121,36 @@ int gettimeofday(struct timeval *tp, void *tz)
     return 0;
 }
 
+int nanosleep(const struct timespec *req, struct timespec *rem)
+{
+    if ((req == NULL) || (req->tv_sec < 0) || (req->tv_nsec < 0)
+        || (req->tv_nsec >= 1000000000))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // There are no signals, so sleeps are never interrupted
+    if (rem != NULL)
+    {
+        rem->tv_sec = 0;
+        rem->tv_nsec = 0;
+    }
+
+    uint64_t usec = (uint64_t)req->tv_sec * 1000000
+                  + ((uint32_t)req->tv_nsec + 999) / 1000;
+
+    while (usec > UINT32_MAX)
+    {
+        cothread_sleep_us(UINT32_MAX);
+        usec -= UINT32_MAX;
+    }
+
+    cothread_sleep_us(usec);
+
+    return 0;
+}
+
 int execve(const char *name, char *const *argv, char *const *env)
 {
     (void)name;
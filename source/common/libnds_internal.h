@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <time.h>
 
+#include <nds/fifomessages.h>
 #include <nds/ndstypes.h>
 #include <nds/system.h>
 
@@ -98,6 +99,87 @@ typedef struct {
     char buffer[];
 } ConsoleArm7Ipc;
 
+// Input state written by the ARM7 and read by the ARM9 when the shared memory
+// mode is enabled. It is protected by a sequence lock: the ARM7 increments the
+// sequence counter before and after updating the block, so it is odd while the
+// block is being updated. The ARM9 reads the counter before and after copying
+// the data, and tries again if the values are different or odd.
+
+#define INPUT_SHARED_HISTORY_SIZE   8 // Must be a power of two
+
+typedef struct {
+    u32 index;
+    u16 vcount;
+    u16 keyinput; // Value of REG_KEYINPUT
+    u16 keyxy;    // Value of REG_KEYXY, with KEYXY_TOUCH set if not pressed
+    u16 reserved;
+    touchPosition touch;
+} InputSharedSample;
+
+typedef struct {
+    vu32 sequence;
+    u32 count; // Number of samples written
+    u32 reserved[2];
+    InputSharedSample history[INPUT_SHARED_HISTORY_SIZE];
+} InputSharedBlock;
+
+// Batch of sound commands. The ARM9 creates it in main RAM and the ARM7 applies
+// all the commands when it receives SOUND_BATCH_MESSAGE. The result of each
+// command is stored in an array of s32 placed after the array of commands.
+
+#define SOUND_BATCH_RECORDING   0
+#define SOUND_BATCH_SUBMITTED   1
+#define SOUND_BATCH_DONE        2
+
+typedef struct SoundBatch SoundBatch;
+
+struct SoundBatch {
+    vu32 state;
+    u32 count;
+    u32 max_count;
+    u32 reserved;
+    FifoMessage commands[];
+};
+
+static inline s32 *soundBatchResults(SoundBatch *batch)
+{
+    return (s32 *)&batch->commands[batch->max_count];
+}
+
+// Queue of SD/eMMC requests. The ARM9 writes SdmmcQueueEntry structs to a ring
+// buffer placed right after the SdmmcQueueShared struct. The ARM7 reads them,
+// merges adjacent requests, and writes the result of each one to the slot
+// selected by the ARM9. The result is written before the done flag.
+
+#define SDMMC_QUEUE_SLOTS   16
+
+typedef struct {
+    u8 slot;
+    u8 device;
+    u8 write;
+    u8 reserved;
+    u32 sector;
+    u32 count;
+    void *buffer;
+} SdmmcQueueEntry;
+
+typedef struct {
+    vu32 done;
+    vs32 result;
+} SdmmcQueueResult;
+
+typedef struct {
+    SdmmcQueueResult results[SDMMC_QUEUE_SLOTS];
+} SdmmcQueueShared;
+
+// The data buffer of the ring must be a power of two
+#define SDMMC_QUEUE_RING_SIZE   (SDMMC_QUEUE_SLOTS * sizeof(SdmmcQueueEntry))
+
+#ifdef FIFO_ENABLE_STATS
+// Records the time between a FIFO RPC request and its answer
+void fifo_stats_rpc_latency(u32 ticks);
+#endif
+
 // Other functions present in the ARM7 and ARM9
 
 void __libnds_exit(int rc);
@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Benchmark of the decompression routines of libnds.
+//
+// The same generated streams are decompressed with the BIOS and the software
+// decoders, to main RAM and to VRAM, and the number of CPU cycles used per
+// output byte is printed. The output is also compared with the data that the
+// generator expects, so this doubles as an on-target conformance check.
+//
+// The BIOS VRAM routines are called through the stream callbacks of
+// decompress(), so they also measure the cost of the callback interface.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nds.h>
+
+#include "generators.h"
+
+// It must fit in VRAM bank A and be a multiple of 4 bytes for Huffman
+#define OUTPUT_SIZE     (64 * 1024)
+
+// The fastest of all the runs is printed
+#define REPEATS         4
+
+typedef enum
+{
+    CODEC_LZ77,
+    CODEC_LZ11,
+    CODEC_LZ4,
+    CODEC_RLE,
+    CODEC_HUFF4,
+    CODEC_HUFF8,
+
+    CODEC_NUM
+} Codec;
+
+typedef enum
+{
+    METHOD_BIOS,
+    METHOD_SOFTWARE,
+    METHOD_INCREMENTAL,
+} Method;
+
+typedef struct
+{
+    const char *name;
+    Codec codec;
+    DecompressType type;
+    Method method;
+    bool vram;
+} BenchCase;
+
+static const BenchCase cases[] = {
+    { "LZ77 BIOS", CODEC_LZ77, LZ77, METHOD_BIOS, false },
+    { "LZ77 BIOS", CODEC_LZ77, LZ77Vram, METHOD_BIOS, true },
+    { "LZ77 SW", CODEC_LZ77, LZ77, METHOD_SOFTWARE, false },
+    { "LZ77 SW", CODEC_LZ77, LZ77Vram, METHOD_SOFTWARE, true },
+    { "LZ77 INC", CODEC_LZ77, LZ77Vram, METHOD_INCREMENTAL, true },
+    { "LZ11 BIOS", CODEC_LZ11, LZ77, METHOD_BIOS, false },
+    { "LZ11 BIOS", CODEC_LZ11, LZ77Vram, METHOD_BIOS, true },
+    { "LZ11 SW", CODEC_LZ11, LZ77, METHOD_SOFTWARE, false },
+    { "LZ11 SW", CODEC_LZ11, LZ77Vram, METHOD_SOFTWARE, true },
+    { "LZ4 SW", CODEC_LZ4, LZ4, METHOD_SOFTWARE, false },
+    { "LZ4 SW", CODEC_LZ4, LZ4Vram, METHOD_SOFTWARE, true },
+    { "RLE BIOS", CODEC_RLE, RLE, METHOD_BIOS, false },
+    { "RLE BIOS", CODEC_RLE, RLEVram, METHOD_BIOS, true },
+    { "RLE INC", CODEC_RLE, RLEVram, METHOD_INCREMENTAL, true },
+    { "HUF4 BIOS", CODEC_HUFF4, HUFF, METHOD_BIOS, false },
+    { "HUF4 BIOS", CODEC_HUFF4, HUFF, METHOD_BIOS, true },
+    { "HUF4 SW", CODEC_HUFF4, HUFF, METHOD_SOFTWARE, false },
+    { "HUF4 SW", CODEC_HUFF4, HUFF, METHOD_SOFTWARE, true },
+    { "HUF8 BIOS", CODEC_HUFF8, HUFF, METHOD_BIOS, false },
+    { "HUF8 BIOS", CODEC_HUFF8, HUFF, METHOD_BIOS, true },
+    { "HUF8 SW", CODEC_HUFF8, HUFF, METHOD_SOFTWARE, false },
+    { "HUF8 SW", CODEC_HUFF8, HUFF, METHOD_SOFTWARE, true },
+};
+
+static Buffer comp[CODEC_NUM];
+static uint8_t *expected[CODEC_NUM];
+
+static void generate_corpus(void)
+{
+    for (int i = 0; i < CODEC_NUM; i++)
+    {
+        buf_init(&comp[i]);
+        expected[i] = malloc(OUTPUT_SIZE);
+        if (expected[i] == NULL)
+        {
+            printf("Out of memory\n");
+            while (1)
+                swiWaitForVBlank();
+        }
+    }
+
+    gen_lz77(&comp[CODEC_LZ77], expected[CODEC_LZ77], OUTPUT_SIZE, false);
+    gen_lz77(&comp[CODEC_LZ11], expected[CODEC_LZ11], OUTPUT_SIZE, true);
+    gen_lz4(&comp[CODEC_LZ4], expected[CODEC_LZ4], OUTPUT_SIZE);
+    gen_rle(&comp[CODEC_RLE], expected[CODEC_RLE], OUTPUT_SIZE);
+    gen_huffman(&comp[CODEC_HUFF4], expected[CODEC_HUFF4], OUTPUT_SIZE, 4);
+    gen_huffman(&comp[CODEC_HUFF8], expected[CODEC_HUFF8], OUTPUT_SIZE, 8);
+
+    // The decoders read the data from main RAM, not from the data cache
+    DC_FlushAll();
+}
+
+// Returns the number of timer ticks used to decompress the data
+static u32 run_case(const BenchCase *c, void *dst)
+{
+    const void *src = comp[c->codec].data;
+
+    if (c->method != METHOD_INCREMENTAL)
+    {
+        decompressSetBackend(c->method == METHOD_BIOS ?
+                             DECOMPRESS_BACKEND_BIOS : DECOMPRESS_BACKEND_SOFTWARE);
+
+        cpuStartTiming(0);
+        decompress(src, dst, c->type);
+        return cpuEndTiming();
+    }
+
+    DecompressIncremental state;
+
+    cpuStartTiming(0);
+    if (decompressIncrementalInit(&state, src, dst, c->type))
+    {
+        while (!decompressIncrementalDone(&state))
+            decompressIncrementalStep(&state, 16 * 1024);
+    }
+    return cpuEndTiming();
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    consoleDemoInit();
+
+    vramSetBankA(VRAM_A_LCD);
+
+    uint8_t *wram_dst = malloc(OUTPUT_SIZE);
+    uint8_t *vram_dst = (uint8_t *)VRAM_A;
+
+    printf("Generating data...\n");
+    generate_corpus();
+
+    // The console has 24 rows, there is only space for one line of header
+    printf("\x1b[2J");
+    printf("Codec       Dest  Cycles/byte\n");
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        const BenchCase *c = &cases[i];
+        uint8_t *dst = c->vram ? vram_dst : wram_dst;
+
+        u32 best = UINT32_MAX;
+        bool ok = true;
+
+        for (int r = 0; r < REPEATS; r++)
+        {
+            memset(dst, 0, OUTPUT_SIZE);
+            DC_FlushAll();
+
+            u32 ticks = run_case(c, dst);
+            if (ticks < best)
+                best = ticks;
+
+            // All the decoders write through the CPU, so the output can be
+            // checked without managing the data cache.
+            if (memcmp(dst, expected[c->codec], OUTPUT_SIZE) != 0)
+                ok = false;
+        }
+
+        // Timer ticks run at the bus clock, which is half the CPU clock
+        u32 centicycles = (u32)(((u64)best * 2 * 100) / OUTPUT_SIZE);
+
+        printf("%-11s %-5s %4u.%02u %s\n", c->name, c->vram ? "VRAM" : "WRAM",
+               (unsigned int)(centicycles / 100),
+               (unsigned int)(centicycles % 100), ok ? "" : "ERR");
+    }
+
+    decompressSetBackend(DECOMPRESS_BACKEND_SOFTWARE);
+
+    // Press START to exit
+    while (1)
+    {
+        swiWaitForVBlank();
+
+        scanKeys();
+        if (keysHeld() & KEY_START)
+            break;
+    }
+
+    return 0;
+}
@@ -0,0 +1,538 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Generators of random compressed streams. They are shared by the conformance
+// tests (built for the host) and the benchmark (built for the NDS).
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "generators.h"
+
+// Random numbers
+// ==============
+
+// The generator is deterministic so that failures can be reproduced
+static uint32_t rng_state = 0x2545F491;
+
+uint32_t rnd(void)
+{
+    uint32_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng_state = x;
+    return x;
+}
+
+// Returns a random number between min and max, both included
+uint32_t rnd_range(uint32_t min, uint32_t max)
+{
+    return min + (rnd() % (max - min + 1));
+}
+
+// Growable buffers
+// ================
+
+void buf_init(Buffer *buf)
+{
+    buf->data = NULL;
+    buf->size = 0;
+    buf->capacity = 0;
+}
+
+void buf_free(Buffer *buf)
+{
+    free(buf->data);
+    buf_init(buf);
+}
+
+void buf_put(Buffer *buf, uint32_t value)
+{
+    if (buf->size == buf->capacity)
+    {
+        buf->capacity = buf->capacity ? buf->capacity * 2 : 1024;
+        buf->data = realloc(buf->data, buf->capacity);
+        if (buf->data == NULL)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+
+    buf->data[buf->size++] = value;
+}
+
+void buf_put32(Buffer *buf, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        buf_put(buf, value >> (i * 8));
+}
+
+// The BIOS requires compressed data to be padded to a multiple of 4 bytes. It
+// also helps the decoders to read the header as a 32-bit value.
+void buf_pad32(Buffer *buf)
+{
+    while (buf->size & 3)
+        buf_put(buf, 0);
+}
+
+// Returns a byte that looks like real data: mostly a small alphabet, so that
+// references are frequent, but also random bytes.
+static uint8_t gen_byte(void)
+{
+    if ((rnd() % 4) == 0)
+        return rnd();
+
+    return 'a' + (rnd() % 8);
+}
+
+// Generators
+// ==========
+
+// They write the compressed stream to "comp" and the decompressed data to
+// "expected".
+
+void gen_lz77(Buffer *comp, uint8_t *expected, uint32_t size, bool lz11)
+{
+    buf_put32(comp, (lz11 ? 0x11 : 0x10) | (size << 8));
+
+    uint32_t pos = 0;
+
+    while (pos < size)
+    {
+        size_t flags_index = comp->size;
+        uint32_t flags = 0;
+        buf_put(comp, 0);
+
+        for (int bit = 7; (bit >= 0) && (pos < size); bit--)
+        {
+            if ((pos == 0) || ((rnd() % 3) == 0))
+            {
+                uint8_t value = gen_byte();
+                expected[pos++] = value;
+                buf_put(comp, value);
+                continue;
+            }
+
+            uint32_t max_disp = pos < 4096 ? pos : 4096;
+            uint32_t disp;
+
+            uint32_t r = rnd() % 10;
+            if (r == 0)
+                disp = 1;
+            else if ((r == 1) && (max_disp >= 2))
+                disp = 2;
+            else if (r < 6)
+                disp = rnd_range(1, max_disp < 32 ? max_disp : 32);
+            else
+                disp = rnd_range(1, max_disp);
+
+            uint32_t d = disp - 1;
+            uint32_t len;
+
+            if (!lz11)
+            {
+                len = rnd_range(3, 18);
+                buf_put(comp, ((len - 3) << 4) | (d >> 8));
+                buf_put(comp, d & 0xFF);
+            }
+            else
+            {
+                r = rnd() % 10;
+                if (r < 6)
+                {
+                    len = rnd_range(3, 16);
+                    buf_put(comp, ((len - 1) << 4) | (d >> 8));
+                    buf_put(comp, d & 0xFF);
+                }
+                else if (r < 9)
+                {
+                    len = rnd_range(0x11, 0x110);
+                    uint32_t l = len - 0x11;
+                    buf_put(comp, l >> 4);
+                    buf_put(comp, ((l & 0xF) << 4) | (d >> 8));
+                    buf_put(comp, d & 0xFF);
+                }
+                else
+                {
+                    len = rnd_range(0x111, 0x2000);
+                    if ((rnd() % 8) == 0)
+                        len = 0x10110; // Longest possible reference
+                    uint32_t l = len - 0x111;
+                    buf_put(comp, 0x10 | (l >> 12));
+                    buf_put(comp, (l >> 4) & 0xFF);
+                    buf_put(comp, ((l & 0xF) << 4) | (d >> 8));
+                    buf_put(comp, d & 0xFF);
+                }
+            }
+
+            flags |= 1 << bit;
+
+            // References that go past the end of the data are truncated
+            for (uint32_t i = 0; (i < len) && (pos < size); i++, pos++)
+                expected[pos] = expected[pos - disp];
+        }
+
+        comp->data[flags_index] = flags;
+    }
+
+    buf_pad32(comp);
+}
+
+static void gen_lz4_length(Buffer *comp, uint32_t len)
+{
+    if (len < 15)
+        return;
+
+    len -= 15;
+    while (len >= 255)
+    {
+        buf_put(comp, 255);
+        len -= 255;
+    }
+    buf_put(comp, len);
+}
+
+void gen_lz4(Buffer *comp, uint8_t *expected, uint32_t size)
+{
+    buf_put32(comp, 0x40 | (size << 8));
+
+    uint32_t pos = 0;
+
+    while (1)
+    {
+        uint32_t remaining = size - pos;
+
+        uint32_t literals;
+        uint32_t r = rnd() % 10;
+        if (r < 3)
+            literals = 0;
+        else if (r < 8)
+            literals = rnd_range(1, 14);
+        else if (r < 9)
+            literals = rnd_range(15, 40);
+        else
+            literals = rnd_range(200, 1000);
+
+        if ((pos == 0) && (literals == 0))
+            literals = 1;
+
+        if (literals >= remaining)
+        {
+            // Last sequence. It only has literals.
+            literals = remaining;
+
+            buf_put(comp, (literals < 15 ? literals : 15) << 4);
+            gen_lz4_length(comp, literals);
+
+            for (uint32_t i = 0; i < literals; i++)
+            {
+                uint8_t value = gen_byte();
+                expected[pos++] = value;
+                buf_put(comp, value);
+            }
+
+            break;
+        }
+
+        uint32_t len;
+        r = rnd() % 10;
+        if (r < 6)
+            len = rnd_range(4, 18);
+        else if (r < 9)
+            len = rnd_range(19, 300);
+        else
+            len = rnd_range(300, 5000);
+
+        uint32_t match = len - 4;
+
+        buf_put(comp, ((literals < 15 ? literals : 15) << 4)
+                      | (match < 15 ? match : 15));
+        gen_lz4_length(comp, literals);
+
+        for (uint32_t i = 0; i < literals; i++)
+        {
+            uint8_t value = gen_byte();
+            expected[pos++] = value;
+            buf_put(comp, value);
+        }
+
+        uint32_t max_offset = pos < 65535 ? pos : 65535;
+        uint32_t offset;
+
+        r = rnd() % 10;
+        if (r == 0)
+            offset = 1;
+        else if ((r == 1) && (max_offset >= 2))
+            offset = 2;
+        else if (r < 6)
+            offset = rnd_range(1, max_offset < 64 ? max_offset : 64);
+        else
+            offset = rnd_range(1, max_offset);
+
+        buf_put(comp, offset & 0xFF);
+        buf_put(comp, offset >> 8);
+        gen_lz4_length(comp, match);
+
+        // Matches that go past the end of the data are truncated
+        for (uint32_t i = 0; (i < len) && (pos < size); i++, pos++)
+            expected[pos] = expected[pos - offset];
+
+        if (pos == size)
+            break;
+    }
+
+    buf_pad32(comp);
+}
+
+void gen_rle(Buffer *comp, uint8_t *expected, uint32_t size)
+{
+    buf_put32(comp, 0x30 | (size << 8));
+
+    uint32_t pos = 0;
+
+    while (pos < size)
+    {
+        if (rnd() % 2)
+        {
+            uint32_t len = rnd_range(3, 130);
+            uint8_t value = gen_byte();
+
+            buf_put(comp, 0x80 | (len - 3));
+            buf_put(comp, value);
+
+            for (uint32_t i = 0; (i < len) && (pos < size); i++)
+                expected[pos++] = value;
+        }
+        else
+        {
+            uint32_t len = rnd_range(1, 128);
+
+            buf_put(comp, len - 1);
+
+            for (uint32_t i = 0; i < len; i++)
+            {
+                uint8_t value = gen_byte();
+                buf_put(comp, value);
+                if (pos < size)
+                    expected[pos++] = value;
+            }
+        }
+    }
+
+    buf_pad32(comp);
+}
+
+// Huffman tree with up to 64 symbols. Nodes 0 to (num_symbols - 1) are leaves.
+typedef struct
+{
+    int num_symbols;
+    int num_nodes;
+    int child[128][2];
+    uint8_t symbol[128];
+    uint32_t weight[128];
+    uint64_t code[128];
+    int code_len[128];
+} HuffTree;
+
+static void huff_build(HuffTree *tree, int num_symbols, int data_bits)
+{
+    tree->num_symbols = num_symbols;
+    tree->num_nodes = num_symbols;
+
+    // Pick different symbols with skewed weights so that some codes are longer
+    // than the lookup table of the decoder.
+    bool used[256] = { false };
+    for (int i = 0; i < num_symbols; i++)
+    {
+        uint32_t s;
+        do
+            s = rnd() & ((1 << data_bits) - 1);
+        while (used[s]);
+        used[s] = true;
+
+        tree->symbol[i] = s;
+        tree->weight[i] = (rnd() % 3 == 0) ? (1u << (rnd() % 16)) : rnd_range(1, 100);
+        tree->child[i][0] = tree->child[i][1] = -1;
+    }
+
+    bool merged[128] = { false };
+
+    for (int n = 0; n < num_symbols - 1; n++)
+    {
+        int a = -1, b = -1;
+
+        for (int i = 0; i < tree->num_nodes; i++)
+        {
+            if (merged[i])
+                continue;
+
+            if ((a < 0) || (tree->weight[i] < tree->weight[a]))
+            {
+                b = a;
+                a = i;
+            }
+            else if ((b < 0) || (tree->weight[i] < tree->weight[b]))
+            {
+                b = i;
+            }
+        }
+
+        int node = tree->num_nodes++;
+        tree->child[node][0] = a;
+        tree->child[node][1] = b;
+        tree->weight[node] = tree->weight[a] + tree->weight[b];
+        merged[a] = merged[b] = true;
+    }
+
+    // Assign codes from the root
+    int root = tree->num_nodes - 1;
+    tree->code[root] = 0;
+    tree->code_len[root] = 0;
+
+    for (int node = root; node >= num_symbols; node--)
+    {
+        for (int bit = 0; bit < 2; bit++)
+        {
+            int c = tree->child[node][bit];
+            tree->code[c] = (tree->code[node] << 1) | bit;
+            tree->code_len[c] = tree->code_len[node] + 1;
+        }
+    }
+}
+
+// Writes the tree in the format of the BIOS, in breadth-first order. It
+// returns false if a node is too far from its children to be encoded.
+static bool huff_write_tree(Buffer *comp, const HuffTree *tree)
+{
+    uint8_t table[256] = { 0 };
+    int index[128];
+    int queue[128];
+    int head = 0, tail = 0;
+
+    int root = tree->num_nodes - 1;
+    index[root] = 1;
+    queue[tail++] = root;
+
+    int next_pair = 2;
+
+    while (head < tail)
+    {
+        int node = queue[head++];
+        int i = index[node];
+        int pair = next_pair;
+        next_pair += 2;
+
+        int offset = (pair - (i & ~1) - 2) / 2;
+        if ((offset < 0) || (offset > 63))
+            return false;
+
+        uint8_t value = offset;
+
+        for (int bit = 0; bit < 2; bit++)
+        {
+            int c = tree->child[node][bit];
+            index[c] = pair + bit;
+
+            if (c < tree->num_symbols)
+            {
+                value |= 0x80 >> bit;
+                table[pair + bit] = tree->symbol[c];
+            }
+            else
+            {
+                queue[tail++] = c;
+            }
+        }
+
+        table[i] = value;
+    }
+
+    // The bitstream must start at a multiple of 4 bytes
+    int size = (next_pair + 3) & ~3;
+    table[0] = size / 2 - 1;
+
+    for (int i = 0; i < size; i++)
+        buf_put(comp, table[i]);
+
+    return true;
+}
+
+void gen_huffman(Buffer *comp, uint8_t *expected, uint32_t size,
+                        int data_bits)
+{
+    HuffTree tree;
+    Buffer tree_data;
+
+    int max_symbols = data_bits == 4 ? 16 : 48;
+
+    // Retry with a different tree if it can't be encoded
+    while (1)
+    {
+        buf_init(&tree_data);
+        huff_build(&tree, rnd_range(2, max_symbols), data_bits);
+        if (huff_write_tree(&tree_data, &tree))
+            break;
+        buf_free(&tree_data);
+    }
+
+    buf_put32(comp, 0x20 | data_bits | (size << 8));
+    for (size_t i = 0; i < tree_data.size; i++)
+        buf_put(comp, tree_data.data[i]);
+    buf_free(&tree_data);
+
+    // The output is written in 32-bit words, so all the symbols of the last
+    // word are encoded even if the size isn't a multiple of 4.
+    uint32_t words = (size + 3) / 4;
+    uint32_t symbols_per_word = 32 / data_bits;
+
+    uint32_t bits = 0;
+    int bit_count = 0;
+
+    for (uint32_t w = 0; w < words; w++)
+    {
+        uint32_t word = 0;
+
+        for (uint32_t s = 0; s < symbols_per_word; s++)
+        {
+            // Pick symbols with probabilities that follow the weights
+            uint32_t total = tree.weight[tree.num_nodes - 1];
+            uint32_t r = rnd() % total;
+            int leaf = 0;
+            while (r >= tree.weight[leaf])
+            {
+                r -= tree.weight[leaf];
+                leaf++;
+            }
+
+            word |= (uint32_t)tree.symbol[leaf] << (s * data_bits);
+
+            for (int b = tree.code_len[leaf] - 1; b >= 0; b--)
+            {
+                bits = (bits << 1) | ((tree.code[leaf] >> b) & 1);
+                bit_count++;
+
+                if (bit_count == 32)
+                {
+                    buf_put32(comp, bits);
+                    bits = 0;
+                    bit_count = 0;
+                }
+            }
+        }
+
+        for (int i = 0; i < 4; i++)
+            expected[w * 4 + i] = word >> (i * 8);
+    }
+
+    if (bit_count > 0)
+        buf_put32(comp, bits << (32 - bit_count));
+
+    // Extra word in case a decoder reads ahead
+    buf_put32(comp, 0);
+}
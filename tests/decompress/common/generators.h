@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#ifndef TESTS_DECOMPRESS_GENERATORS_H__
+#define TESTS_DECOMPRESS_GENERATORS_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Random numbers. The generator is deterministic so that failures can be
+// reproduced.
+uint32_t rnd(void);
+// Returns a random number between min and max, both included
+uint32_t rnd_range(uint32_t min, uint32_t max);
+
+// Growable buffers
+typedef struct
+{
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} Buffer;
+
+void buf_init(Buffer *buf);
+void buf_free(Buffer *buf);
+void buf_put(Buffer *buf, uint32_t value);
+void buf_put32(Buffer *buf, uint32_t value);
+void buf_pad32(Buffer *buf);
+
+// Generators. They write the compressed stream to "comp" and the decompressed
+// data to "expected". Huffman data is decompressed in 32-bit words, so
+// "expected" must have space for "size" rounded up to a multiple of 4.
+void gen_lz77(Buffer *comp, uint8_t *expected, uint32_t size, bool lz11);
+void gen_lz4(Buffer *comp, uint8_t *expected, uint32_t size);
+void gen_rle(Buffer *comp, uint8_t *expected, uint32_t size);
+void gen_huffman(Buffer *comp, uint8_t *expected, uint32_t size, int data_bits);
+
+#endif // TESTS_DECOMPRESS_GENERATORS_H__
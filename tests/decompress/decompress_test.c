@@ -0,0 +1,435 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+// Conformance tests of the software decompression routines of libnds. They are
+// built for the host, not for the NDS.
+//
+// Each test generates a random compressed stream together with the data it
+// decompresses to. The stream is also decoded by a simple reference decoder
+// that follows the format byte by byte, like the BIOS does. Then, the output of
+// each libnds decoder is compared against it byte for byte. The bytes after the
+// end of the output are checked too, as the VRAM decoders must preserve the
+// byte after an odd-sized output.
+//
+// The generators create streams with all the corner cases of each format:
+// overlapping references (displacement 1 and 2), references that go past the
+// end of the output (the BIOS truncates them), long length extensions, Huffman
+// codes longer than the lookup table, etc.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nds/decompress.h>
+
+#include "common/decompress_internal.h"
+
+#include "generators.h"
+
+#define GUARD_SIZE  64
+#define GUARD_BYTE  0xA5
+
+static unsigned int tests_run;
+static unsigned int tests_failed;
+
+// Reference decoders
+// ==================
+
+// They follow the formats one byte (or one bit) at a time, like the BIOS.
+
+static uint32_t read32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void ref_lz77(const uint8_t *src, uint8_t *dst)
+{
+    uint32_t header = read32(src);
+    uint32_t size = header >> 8;
+    bool lz11 = (header & 0xFF) == 0x11;
+    const uint8_t *in = src + 4;
+    uint32_t pos = 0;
+
+    while (pos < size)
+    {
+        uint8_t flags = *in++;
+
+        for (int bit = 7; (bit >= 0) && (pos < size); bit--)
+        {
+            if (!(flags & (1 << bit)))
+            {
+                dst[pos++] = *in++;
+                continue;
+            }
+
+            uint32_t len, disp;
+            uint32_t b0 = *in++;
+
+            if (lz11 && ((b0 >> 4) == 0))
+            {
+                uint32_t b1 = *in++, b2 = *in++;
+                len = ((b0 << 4) | (b1 >> 4)) + 0x11;
+                disp = (((b1 & 0xF) << 8) | b2) + 1;
+            }
+            else if (lz11 && ((b0 >> 4) == 1))
+            {
+                uint32_t b1 = *in++, b2 = *in++, b3 = *in++;
+                len = (((b0 & 0xF) << 12) | (b1 << 4) | (b2 >> 4)) + 0x111;
+                disp = (((b2 & 0xF) << 8) | b3) + 1;
+            }
+            else
+            {
+                uint32_t b1 = *in++;
+                len = (b0 >> 4) + (lz11 ? 1 : 3);
+                disp = (((b0 & 0xF) << 8) | b1) + 1;
+            }
+
+            for (uint32_t i = 0; (i < len) && (pos < size); i++, pos++)
+                dst[pos] = dst[pos - disp];
+        }
+    }
+}
+
+static uint32_t ref_lz4_length(const uint8_t **in, uint32_t len)
+{
+    if (len == 15)
+    {
+        uint8_t value;
+        do
+        {
+            value = *(*in)++;
+            len += value;
+        }
+        while (value == 255);
+    }
+    return len;
+}
+
+static void ref_lz4(const uint8_t *src, uint8_t *dst)
+{
+    uint32_t size = read32(src) >> 8;
+    const uint8_t *in = src + 4;
+    uint32_t pos = 0;
+
+    while (pos < size)
+    {
+        uint8_t token = *in++;
+
+        uint32_t len = ref_lz4_length(&in, token >> 4);
+        for (uint32_t i = 0; (i < len) && (pos < size); i++)
+            dst[pos++] = *in++;
+
+        if (pos >= size)
+            break;
+
+        uint32_t offset = in[0] | (in[1] << 8);
+        in += 2;
+
+        len = ref_lz4_length(&in, token & 0xF) + 4;
+        for (uint32_t i = 0; (i < len) && (pos < size); i++, pos++)
+            dst[pos] = dst[pos - offset];
+    }
+}
+
+static void ref_rle(const uint8_t *src, uint8_t *dst)
+{
+    uint32_t size = read32(src) >> 8;
+    const uint8_t *in = src + 4;
+    uint32_t pos = 0;
+
+    while (pos < size)
+    {
+        uint8_t flag = *in++;
+
+        if (flag & 0x80)
+        {
+            uint32_t len = (flag & 0x7F) + 3;
+            uint8_t value = *in++;
+            for (uint32_t i = 0; (i < len) && (pos < size); i++)
+                dst[pos++] = value;
+        }
+        else
+        {
+            uint32_t len = (flag & 0x7F) + 1;
+            for (uint32_t i = 0; (i < len) && (pos < size); i++)
+                dst[pos++] = *in++;
+        }
+    }
+}
+
+static void ref_huffman(const uint8_t *src, uint8_t *dst)
+{
+    uint32_t header = read32(src);
+    uint32_t data_bits = header & 0xF;
+    uint32_t words = ((header >> 8) + 3) / 4;
+
+    const uint8_t *root = src + 5;
+    const uint8_t *stream = src + 4 + ((src[4] + 1) * 2);
+
+    uint32_t bits = 0;
+    int bit_count = 0;
+
+    for (uint32_t w = 0; w < words; w++)
+    {
+        uint32_t word = 0;
+
+        for (uint32_t shift = 0; shift < 32; shift += data_bits)
+        {
+            const uint8_t *node = root;
+
+            while (1)
+            {
+                if (bit_count == 0)
+                {
+                    bits = read32(stream);
+                    stream += 4;
+                    bit_count = 32;
+                }
+
+                uint32_t bit = (bits >> 31) & 1;
+                bits <<= 1;
+                bit_count--;
+
+                uintptr_t offset = node - (src + 4);
+                const uint8_t *child = src + 4 + (offset & ~(uintptr_t)1)
+                                     + ((*node & 0x3F) * 2) + 2 + bit;
+                bool is_data = *node & (0x80 >> bit);
+                node = child;
+
+                if (is_data)
+                    break;
+            }
+
+            word |= (uint32_t)*node << shift;
+        }
+
+        for (int i = 0; i < 4; i++)
+            dst[w * 4 + i] = word >> (i * 8);
+    }
+}
+
+// Test helpers
+// ============
+
+static uint8_t *alloc_output(uint32_t size)
+{
+    uint8_t *dst = malloc(size + GUARD_SIZE);
+    if (dst == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    memset(dst, GUARD_BYTE, size + GUARD_SIZE);
+    return dst;
+}
+
+// Compares the output of a decoder with the expected data, and checks that the
+// bytes after the output haven't been modified.
+static void check(const char *name, uint32_t size, const uint8_t *expected,
+                  const uint8_t *dst)
+{
+    tests_run++;
+
+    for (uint32_t i = 0; i < size + GUARD_SIZE; i++)
+    {
+        uint8_t want = i < size ? expected[i] : GUARD_BYTE;
+        if (dst[i] != want)
+        {
+            fprintf(stderr, "FAIL: %s (size %u): byte %u is 0x%02X, not 0x%02X\n",
+                    name, size, i, dst[i], want);
+            tests_failed++;
+            return;
+        }
+    }
+}
+
+static void run_incremental(const char *name, const uint8_t *comp,
+                            uint32_t size, const uint8_t *expected,
+                            DecompressType type)
+{
+    uint8_t *dst = alloc_output(size);
+
+    DecompressIncremental state;
+    if (!decompressIncrementalInit(&state, comp, dst, type))
+    {
+        fprintf(stderr, "FAIL: %s (size %u): init failed\n", name, size);
+        tests_run++;
+        tests_failed++;
+        free(dst);
+        return;
+    }
+
+    // Use steps of random sizes, including very small ones, so that the
+    // decoders stop in the middle of references and runs.
+    uint32_t max_step = rnd_range(1, 4096);
+    uint32_t steps = 0;
+
+    while (!decompressIncrementalDone(&state))
+    {
+        size_t done = decompressIncrementalStep(&state, rnd_range(1, max_step));
+        if ((done == 0) || (++steps > size + 1))
+        {
+            fprintf(stderr, "FAIL: %s (size %u): no progress\n", name, size);
+            tests_run++;
+            tests_failed++;
+            free(dst);
+            return;
+        }
+    }
+
+    check(name, size, expected, dst);
+
+    free(dst);
+}
+
+// Tests
+// =====
+
+static void test_lz77(uint32_t size, bool lz11)
+{
+    Buffer comp;
+    buf_init(&comp);
+
+    uint8_t *expected = malloc(size + 1);
+    gen_lz77(&comp, expected, size, lz11);
+
+    uint8_t *ref = alloc_output(size);
+    ref_lz77(comp.data, ref);
+    check(lz11 ? "reference LZ77 0x11" : "reference LZ77 0x10", size,
+          expected, ref);
+    free(ref);
+
+    uint8_t *dst = alloc_output(size);
+    decompress_lz77_wram(comp.data, dst);
+    check(lz11 ? "LZ77 0x11 WRAM" : "LZ77 0x10 WRAM", size, expected, dst);
+    free(dst);
+
+    dst = alloc_output(size);
+    decompress_lz77_vram(comp.data, dst);
+    check(lz11 ? "LZ77 0x11 VRAM" : "LZ77 0x10 VRAM", size, expected, dst);
+    free(dst);
+
+    run_incremental(lz11 ? "incremental LZ77 0x11" : "incremental LZ77 0x10",
+                    comp.data, size, expected, LZ77);
+    run_incremental(lz11 ? "incremental LZ77Vram 0x11"
+                         : "incremental LZ77Vram 0x10",
+                    comp.data, size, expected, LZ77Vram);
+
+    free(expected);
+    buf_free(&comp);
+}
+
+static void test_lz4(uint32_t size)
+{
+    Buffer comp;
+    buf_init(&comp);
+
+    uint8_t *expected = malloc(size + 1);
+    gen_lz4(&comp, expected, size);
+
+    uint8_t *ref = alloc_output(size);
+    ref_lz4(comp.data, ref);
+    check("reference LZ4", size, expected, ref);
+    free(ref);
+
+    uint8_t *dst = alloc_output(size);
+    decompress_lz4_wram(comp.data, dst);
+    check("LZ4 WRAM", size, expected, dst);
+    free(dst);
+
+    dst = alloc_output(size);
+    decompress_lz4_vram(comp.data, dst);
+    check("LZ4 VRAM", size, expected, dst);
+    free(dst);
+
+    free(expected);
+    buf_free(&comp);
+}
+
+static void test_rle(uint32_t size)
+{
+    Buffer comp;
+    buf_init(&comp);
+
+    uint8_t *expected = malloc(size + 1);
+    gen_rle(&comp, expected, size);
+
+    uint8_t *ref = alloc_output(size);
+    ref_rle(comp.data, ref);
+    check("reference RLE", size, expected, ref);
+    free(ref);
+
+    run_incremental("incremental RLE", comp.data, size, expected, RLE);
+    run_incremental("incremental RLEVram", comp.data, size, expected, RLEVram);
+
+    free(expected);
+    buf_free(&comp);
+}
+
+static void test_huffman(uint32_t size, int data_bits)
+{
+    Buffer comp;
+    buf_init(&comp);
+
+    // Huffman decoders write whole words
+    uint32_t out_size = (size + 3) & ~3;
+
+    uint8_t *expected = malloc(out_size);
+    gen_huffman(&comp, expected, size, data_bits);
+
+    uint8_t *ref = alloc_output(out_size);
+    ref_huffman(comp.data, ref);
+    check(data_bits == 4 ? "reference Huffman 4-bit" : "reference Huffman 8-bit",
+          out_size, expected, ref);
+    free(ref);
+
+    uint32_t table[DECOMPRESS_HUFFMAN_TABLE_SIZE];
+    uint8_t *dst = alloc_output(out_size);
+    decompress_huffman(comp.data, dst, table);
+    check(data_bits == 4 ? "Huffman 4-bit" : "Huffman 8-bit",
+          out_size, expected, dst);
+    free(dst);
+
+    run_incremental(data_bits == 4 ? "incremental Huffman 4-bit"
+                                   : "incremental Huffman 8-bit",
+                    comp.data, out_size, expected, HUFF);
+
+    free(expected);
+    buf_free(&comp);
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = 20;
+    if (argc > 1)
+        rounds = atoi(argv[1]);
+
+    static const uint32_t sizes[] = {
+        1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 100, 255, 256, 257,
+        1000, 4095, 4096, 4097, 10001, 65536, 65539, 200001
+    };
+
+    for (int round = 0; round < rounds; round++)
+    {
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        {
+            uint32_t size = sizes[i];
+
+            test_lz77(size, false);
+            test_lz77(size, true);
+            test_lz4(size);
+            test_rle(size);
+            test_huffman(size, 4);
+            test_huffman(size, 8);
+        }
+    }
+
+    printf("%u tests run, %u failed\n", tests_run, tests_failed);
+
+    return tests_failed == 0 ? 0 : 1;
+}
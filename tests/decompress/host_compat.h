@@ -0,0 +1,19 @@
+// SPDX-License-Identifier: Zlib
+//
+// Copyright (c) 2024 Antonio Niño Díaz
+
+#ifndef TESTS_DECOMPRESS_HOST_COMPAT_H__
+#define TESTS_DECOMPRESS_HOST_COMPAT_H__
+
+// This file is included before every source file of the library that is built
+// for the host. It removes the attributes that only make sense for ARM targets.
+
+#include <nds/ndstypes.h>
+
+#undef ARM_CODE
+#define ARM_CODE
+
+#undef THUMB_CODE
+#define THUMB_CODE
+
+#endif // TESTS_DECOMPRESS_HOST_COMPAT_H__